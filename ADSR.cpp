@@ -101,6 +101,13 @@ bool ADSR::isActive()
 	return (state_ != StateOff);
 }
 
+// Indicate whether the envelope is still rising in the Attack state,
+// where a low level does not mean the note is about to end
+bool ADSR::isAttacking() 
+{
+	return (state_ == StateAttack);
+}
+
 // Methods to set the value of the parameters. We constrain
 // each parameter to a sensible range
 void ADSR::setAttackTime(float attackTime)
@@ -51,6 +51,12 @@ public:
 	// anything other than the Off state
 	bool isActive();
 	
+	// Indicate whether the envelope is still rising in the Attack state
+	bool isAttacking();
+	
+	// Return the current output level without advancing the envelope
+	float getCurrentLevel() { return ramp_.currentLevel(); }
+	
 	// Methods for getting and setting parameters
 	float getAttackTime() { return attackTime_; }
 	float getDecayTime() { return decayTime_; }
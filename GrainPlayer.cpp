@@ -0,0 +1,113 @@
+#include "GrainPlayer.h"
+#include <cmath>
+
+GrainPlayer::GrainPlayer() :
+    grainLength(0), hopSize(0), buffer(nullptr), length(0),
+    readPosition(0), framesUntilNextGrain(0), speed(1.0)
+{
+    for (int i = 0; i < kOverlap; i++)
+        grains[i].active = false;
+}
+
+void GrainPlayer::setup(float sampleRate, float grainLength) {
+    // The grain length is a multiple of the overlap so the grains fit exactly
+    hopSize = (int)(sampleRate * grainLength / kOverlap);
+    if (hopSize < 1)
+        hopSize = 1;
+    this->grainLength = hopSize * kOverlap;
+
+    // A periodic Hann window overlapped every quarter of its length sums to 2
+    window.resize(this->grainLength);
+    for (int n = 0; n < this->grainLength; n++)
+        window[n] = (2.0 / kOverlap) * 0.5 * (1.0 - cos(2.0 * M_PI * n / this->grainLength));
+}
+
+void GrainPlayer::start(const float* buffer, int length) {
+    this->buffer = buffer;
+    this->length = length;
+    readPosition = 0;
+    framesUntilNextGrain = 0;
+
+    // Prime the pool as if grains had already been playing before the loop
+    // start, so the window overlap sums to 1 from the first frame. Each one
+    // started a whole number of hops ago, wrapping back from the loop end
+    grains[0].active = false;
+    for (int i = 1; i < kOverlap; i++) {
+        grains[i].active = (length > 0);
+        grains[i].age = i * hopSize;
+        double start = fmod(-speed * grains[i].age, (double)length);
+        if (start < 0)
+            start += length;
+        grains[i].start = (int)start;
+    }
+}
+
+void GrainPlayer::setSpeed(float speed) {
+    if (speed > 0)
+        this->speed = speed;
+}
+
+float GrainPlayer::getSpeed() const {
+    return speed;
+}
+
+// Take a free grain from the pool. At most kOverlap grains overlap, so
+// one is always free when a new one is due
+void GrainPlayer::startGrain() {
+    for (int i = 0; i < kOverlap; i++) {
+        if (!grains[i].active) {
+            grains[i].active = true;
+            grains[i].start = (int)readPosition;
+            grains[i].age = 0;
+            return;
+        }
+    }
+}
+
+// The output is built in runs between grain starts. In each run every
+// active grain adds its windowed frames, wrapping around the end of the loop
+void GrainPlayer::render(float* out, int frames) {
+    for (int n = 0; n < frames; n++)
+        out[n] = 0;
+    if (buffer == nullptr || grainLength == 0)
+        return;
+
+    int n = 0;
+    while (n < frames) {
+        if (framesUntilNextGrain == 0) {
+            startGrain();
+            framesUntilNextGrain = hopSize;
+            // At speed 1 each grain starts where the previous one was a hop
+            // later, so the grains add back up to the original loop
+            readPosition += speed * hopSize;
+            while (readPosition >= length)
+                readPosition -= length;
+        }
+
+        int run = frames - n;
+        if (run > framesUntilNextGrain)
+            run = framesUntilNextGrain;
+
+        for (int i = 0; i < kOverlap; i++) {
+            Grain& grain = grains[i];
+            if (!grain.active)
+                continue;
+
+            int grainFrames = grainLength - grain.age;
+            if (grainFrames > run)
+                grainFrames = run;
+            int readPointer = (grain.start + grain.age) % length;
+            for (int k = 0; k < grainFrames; k++) {
+                out[n + k] += window[grain.age + k] * buffer[readPointer];
+                if (++readPointer >= length)
+                    readPointer = 0;
+            }
+            grain.age += grainFrames;
+            if (grain.age >= grainLength)
+                grain.active = false;
+        }
+
+        framesUntilNextGrain -= run;
+        n += run;
+    }
+}
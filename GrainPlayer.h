@@ -0,0 +1,51 @@
+#ifndef GRAINPLAYER_H
+#define GRAINPLAYER_H
+
+#include <vector>
+
+// Granular player for loops: overlapping windowed grains are read from
+// the loop at its original pitch, while the point they are read from
+// moves through the loop at an adjustable speed. This changes the tempo
+// of the loop without changing its pitch
+class GrainPlayer {
+public:
+    // Number of grains playing at the same time once started
+    static const int kOverlap = 4;
+
+    GrainPlayer();
+
+    // Set the sample rate and grain length, allocating the window. Not real-time safe
+    void setup(float sampleRate, float grainLength = 0.05);
+
+    // Start playing a loop from its first frame, with the grains already overlapping
+    void start(const float* buffer, int length);
+
+    // Setter and getter for the speed through the loop: 1 is the recorded tempo, 0.5 half of it
+    void setSpeed(float speed);
+    float getSpeed() const;
+
+    // Write the next frames of the granular output into out
+    void render(float* out, int frames);
+
+private:
+    struct Grain {
+        bool active;
+        int start;  // Frame of the loop where the grain starts
+        int age;    // Frames of the grain already played
+    };
+
+    Grain grains[kOverlap];      // Preallocated grain pool
+    std::vector<float> window;   // Hann window scaled so overlapping grains sum to 1
+    int grainLength;
+    int hopSize;                 // Frames between the starts of consecutive grains
+
+    const float* buffer;
+    int length;
+    double readPosition;         // Where the next grain starts in the loop
+    int framesUntilNextGrain;
+    float speed;
+
+    void startGrain();
+};
+
+#endif // GRAINPLAYER_H
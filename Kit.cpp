@@ -0,0 +1,19 @@
+#include "Kit.h"
+
+void kitNoteOn(Sampler* samplers, const Kit& kit, int noteNumber) {
+    int last = kit.firstSampler + kit.numSamplers;
+    for (int i = kit.firstSampler; i < last; ++i) {
+        if (noteNumber == samplers[i].getMidiNote()) {
+            samplers[i].trigger();
+        }
+    }
+}
+
+void kitNoteOff(Sampler* samplers, const Kit& kit, int noteNumber) {
+    int last = kit.firstSampler + kit.numSamplers;
+    for (int i = kit.firstSampler; i < last; ++i) {
+        if (noteNumber == samplers[i].getMidiNote() && samplers[i].getReleaseOnNoteOff()) {
+            samplers[i].release();
+        }
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef KIT_H
+#define KIT_H
+
+#include "Sampler.h"
+
+// Kits are groups of consecutive samplers that a MIDI channel can play
+struct Kit {
+    int firstSampler;
+    int numSamplers;
+};
+
+// Kit of a MIDI channel that plays no samplers
+const int kKitNone = -1;
+
+// Trigger the samplers of a kit that play a MIDI note
+void kitNoteOn(Sampler* samplers, const Kit& kit, int noteNumber);
+
+// Release the samplers of a kit that play a MIDI note and release on note off
+void kitNoteOff(Sampler* samplers, const Kit& kit, int noteNumber);
+
+#endif // KIT_H
@@ -0,0 +1,44 @@
+#include "MidiPorts.h"
+#include <alsa/asoundlib.h>
+#include <cstdio>
+
+std::vector<std::string> findMidiInputPorts() {
+    std::vector<std::string> ports;
+    int card = -1;
+    
+    // Allocated once: snd_rawmidi_info_alloca() inside the loop would grow the stack on every device
+    snd_rawmidi_info_t* info;
+    if (snd_rawmidi_info_malloc(&info) < 0)
+        return ports;
+    
+    // Walk through every sound card, every raw MIDI device on the card
+    // and every input subdevice of the device
+    while (snd_card_next(&card) == 0 && card >= 0) {
+        char cardName[32];
+        snprintf(cardName, sizeof(cardName), "hw:%d", card);
+        
+        snd_ctl_t* control;
+        if (snd_ctl_open(&control, cardName, 0) < 0)
+            continue;
+        
+        int device = -1;
+        while (snd_ctl_rawmidi_next_device(control, &device) == 0 && device >= 0) {
+            snd_rawmidi_info_set_device(info, device);
+            snd_rawmidi_info_set_stream(info, SND_RAWMIDI_STREAM_INPUT);
+            snd_rawmidi_info_set_subdevice(info, 0);
+            if (snd_ctl_rawmidi_info(control, info) < 0)
+                continue;
+            
+            int subdevices = snd_rawmidi_info_get_subdevices_count(info);
+            for (int subdevice = 0; subdevice < subdevices; subdevice++) {
+                char portName[32];
+                snprintf(portName, sizeof(portName), "hw:%d,%d,%d", card, device, subdevice);
+                ports.push_back(portName);
+            }
+        }
+        snd_ctl_close(control);
+    }
+    
+    snd_rawmidi_info_free(info);
+    return ports;
+}
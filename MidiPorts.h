@@ -0,0 +1,11 @@
+#ifndef MIDIPORTS_H
+#define MIDIPORTS_H
+
+#include <vector>
+#include <string>
+
+// Find the ALSA raw MIDI ports that can be read from, named the way
+// Midi::readFrom() expects them ("hw:card,device,subdevice")
+std::vector<std::string> findMidiInputPorts();
+
+#endif // MIDIPORTS_H
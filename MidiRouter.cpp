@@ -0,0 +1,112 @@
+#include "MidiRouter.h"
+#include <cmath>
+
+MidiRouter::MidiRouter() :
+    numPorts(0), clockPort(-1), samplers(nullptr), kits(nullptr), sequencer(nullptr),
+    loopSpeedController(-1)
+{
+}
+
+void MidiRouter::setup(Sampler* samplers, const Kit* kits, Sequencer* sequencer) {
+    this->samplers = samplers;
+    this->kits = kits;
+    this->sequencer = sequencer;
+}
+
+int MidiRouter::addPort(const int channelKits[16]) {
+    if (numPorts >= kMaxPorts)
+        return -1;
+
+    Port& port = ports[numPorts];
+    for (int channel = 0; channel < 16; channel++)
+        port.channelKits[channel] = channelKits[channel];
+    port.status = 0;
+    port.dataCount = 0;
+    return numPorts++;
+}
+
+int MidiRouter::getNumPorts() const {
+    return numPorts;
+}
+
+void MidiRouter::setLoopSpeedController(int controller) {
+    loopSpeedController = controller;
+}
+
+// Real-time messages (clock and transport) can arrive in between the bytes
+// of any other message, and channel messages can omit their status byte
+// when it repeats (running status)
+void MidiRouter::parseByte(int port, unsigned char byte) {
+    Port& midiPort = ports[port];
+
+    if (byte >= 0xF8) {
+        if (sequencer == nullptr)
+            return;
+        // The first port to send clock drives the sequencer, until it sends stop
+        if (byte == 0xF8 || byte == 0xFA || byte == 0xFB || byte == 0xFC) {
+            if (clockPort < 0)
+                clockPort = port;
+            else if (clockPort != port)
+                return;
+        }
+        if (byte == 0xF8) {
+            sequencer->clockTick();
+        } else if (byte == 0xFA) {
+            sequencer->start();
+        } else if (byte == 0xFB) {
+            sequencer->continuePlaying();
+        } else if (byte == 0xFC) {
+            sequencer->stop();
+            clockPort = -1;
+        }
+        return;
+    }
+
+    if (byte >= 0x80) {
+        // System common messages and sysex are ignored up to the next status byte
+        midiPort.status = (byte < 0xF0) ? byte : 0;
+        midiPort.dataCount = 0;
+        return;
+    }
+
+    if (midiPort.status == 0)
+        return;
+
+    midiPort.data[midiPort.dataCount++] = byte;
+
+    // Program change and channel pressure have one data byte, the others two
+    int type = midiPort.status & 0xF0;
+    int dataLength = (type == 0xC0 || type == 0xD0) ? 1 : 2;
+    if (midiPort.dataCount < dataLength)
+        return;
+
+    midiPort.dataCount = 0;
+    handleMessage(port, midiPort.status, midiPort.data);
+}
+
+// Handle a complete channel message from a port
+void MidiRouter::handleMessage(int port, unsigned char status, const unsigned char* data) {
+    int type = status & 0xF0;
+    int kit = ports[port].channelKits[status & 0x0F];
+    if (kit == kKitNone)
+        return;
+
+    // A note on with a velocity of 0 is really a note off
+    if (type == 0x90 && data[1] > 0) {
+        kitNoteOn(samplers, kits[kit], data[0]);
+    } else if (type == 0x90 || type == 0x80) {
+        kitNoteOff(samplers, kits[kit], data[0]);
+    } else if (type == 0xB0 && data[0] == loopSpeedController) {
+        // 64 steps below the centre value and 63 above it, so 127 reaches twice
+        float octaves = (data[1] - 64) / (data[1] >= 64 ? 63.0 : 64.0);
+        float speed = powf(2.0, octaves);
+        int last = kits[kit].firstSampler + kits[kit].numSamplers;
+        for (int i = kits[kit].firstSampler; i < last; ++i) {
+            if (samplers[i].getGranularMode())
+                samplers[i].setTimeStretch(speed);
+        }
+    } else if (type == 0xC0 && sequencer != nullptr) {
+        // Program change selects the sequencer pattern
+        sequencer->selectPattern(data[0]);
+    }
+}
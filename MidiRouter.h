@@ -0,0 +1,54 @@
+#ifndef MIDIROUTER_H
+#define MIDIROUTER_H
+
+#include "Kit.h"
+#include "Sequencer.h"
+
+// Parser for the raw bytes of several MIDI ports. Notes go to the samplers
+// of the kit mapped to their port and channel, clock, transport and
+// program change go to the sequencer. Each port keeps its own running
+// status, and real-time messages can come in between the bytes of any
+// other message
+class MidiRouter {
+public:
+    static const int kMaxPorts = 8;
+
+    MidiRouter();
+
+    // Set the samplers and kits that notes are routed to, and the sequencer
+    // driven by clock, transport and program change (nullptr for none)
+    void setup(Sampler* samplers, const Kit* kits, Sequencer* sequencer);
+
+    // Add a port with the kit played by each of its 16 channels (kKitNone
+    // ignores the channel). Returns the index of the port, or -1 if there
+    // is no room for it
+    int addPort(const int channelKits[16]);
+    int getNumPorts() const;
+
+    // Setter for the control change that sets the speed of the granular loops of a kit
+    void setLoopSpeedController(int controller);
+
+    // Parse one byte received from a port, handling the message it completes
+    void parseByte(int port, unsigned char byte);
+
+private:
+    struct Port {
+        int channelKits[16];
+        unsigned char status;
+        unsigned char data[2];
+        int dataCount;
+    };
+
+    Port ports[kMaxPorts];
+    int numPorts;
+    int clockPort;  // Only one port at a time can drive the sequencer clock
+
+    Sampler* samplers;
+    const Kit* kits;
+    Sequencer* sequencer;
+    int loopSpeedController;
+
+    void handleMessage(int port, unsigned char status, const unsigned char* data);
+};
+
+#endif // MIDIROUTER_H
@@ -1,16 +1,15 @@
 #include "Sampler.h"
 #include <libraries/AudioFile/AudioFile.h>
-#include <cstdlib>
 #include <ctime>
+#include <cmath>
 
 
 Sampler::Sampler() : 
-    readPointer(-1), sampleSelector(0),
+    voices(nullptr), voice(0), sampleSelector(0), randomState(1),
     attackTime(0.01), decayTime(0.25), sustainLevel(0.0), releaseTime(3.0), 
-	midiNote(-1), releaseOnNoteOff(true), loopMode(false)
+	midiNote(-1), releaseOnNoteOff(true), loopMode(false), granularMode(false),
+	autoTrim(true), onsetThresholdDb(-60.0), tailThresholdDb(-70.0), retireThreshold(0.0001)
 {
-    amplitudeADSR.setSampleRate(44100.0f); // Default sample rate, should be overridden in setup()
-    updateADSR();
 }
 
 void Sampler::setFilenames(const std::vector<std::string>& filenames) {
@@ -18,7 +17,6 @@ void Sampler::setFilenames(const std::vector<std::string>& filenames) {
 }
 
 void Sampler::setup(float sampleRate) {
-    amplitudeADSR.setSampleRate(sampleRate);
     sampleBuffers.resize(filenames.size());
     for (size_t i = 0; i < filenames.size(); i++) {
         sampleBuffers[i] = AudioFileUtilities::loadMono(filenames[i]);
@@ -30,21 +28,137 @@ void Sampler::setup(float sampleRate) {
     			sampleBuffers[i].size() / sampleRate, sampleRate);
         }
     }
-    std::srand(std::time(0)); // Seed the random number generator
+    analyseSamples(sampleRate);
+    grains.setup(sampleRate);
+    for (size_t i = 0; i < filenames.size(); i++) {
+        rt_printf("  '%s': onset at frame %d, inaudible after frame %d, peak %.1f dBFS, rms %.1f dBFS\n",
+        	filenames[i].c_str(), sampleInfos[i].onsetFrame, sampleInfos[i].inaudibleAfterFrame,
+        	20.0 * log10f(sampleInfos[i].peak + 1e-9f), 20.0 * log10f(sampleInfos[i].rms + 1e-9f));
+    }
+    setRandomSeed(std::time(0) + voice); // Seed the random number generator
+}
+
+void Sampler::setSampleBuffers(const std::vector<std::vector<float>>& buffers, float sampleRate) {
+    for (size_t i = 0; i < buffers.size(); i++) {
+        if (buffers[i].size() == 0) {
+            throw std::runtime_error("Empty sample buffer");
+        }
+    }
+    sampleBuffers = buffers;
+    analyseSamples(sampleRate);
+    grains.setup(sampleRate);
+}
+
+void Sampler::setRandomSeed(unsigned int seed) {
+    randomState = seed;
+}
+
+// Linear congruential generator: unlike std::rand() it takes no lock and
+// each sampler has its own sequence, so a given seed always gives the same choices
+unsigned int Sampler::nextRandom() {
+    randomState = randomState * 1664525u + 1013904223u;
+    return randomState >> 16;
+}
+
+void Sampler::analyseSamples(float sampleRate) {
+    sampleInfos.resize(sampleBuffers.size());
+    for (size_t i = 0; i < sampleBuffers.size(); i++) {
+        analyseSample(i, sampleRate);
+    }
+}
+
+// Scan a sound file once at load time to find where it becomes audible,
+// where it stops being audible, and its peak and RMS levels
+void Sampler::analyseSample(int index, float sampleRate) {
+    const std::vector<float>& buffer = sampleBuffers[index];
+    SampleInfo& info = sampleInfos[index];
+    float onsetThreshold = powf(10.0, onsetThresholdDb / 20.0);
+    float tailThreshold = powf(10.0, tailThresholdDb / 20.0);
+    int size = buffer.size();
+    int firstAbove = -1;
+    int lastAbove = -1;
+    double sumOfSquares = 0;
+    
+    info.peak = 0;
+    for (int n = 0; n < size; n++) {
+        float level = fabsf(buffer[n]);
+        if (level > info.peak)
+            info.peak = level;
+        if (firstAbove < 0 && level >= onsetThreshold)
+            firstAbove = n;
+        if (level >= tailThreshold)
+            lastAbove = n;
+        sumOfSquares += buffer[n] * buffer[n];
+    }
+    info.rms = sqrtf(sumOfSquares / size);
+    
+    // Peak of the remainder of the file from the start of each block,
+    // found by walking backwards through the file
+    int numBlocks = (size + VoiceBank::kRetireCheckInterval - 1) / VoiceBank::kRetireCheckInterval;
+    info.tailPeaks.assign(numBlocks, 0);
+    float tailPeak = 0;
+    for (int n = size - 1; n >= 0; n--) {
+        float level = fabsf(buffer[n]);
+        if (level > tailPeak)
+            tailPeak = level;
+        if (n % VoiceBank::kRetireCheckInterval == 0)
+            info.tailPeaks[n / VoiceBank::kRetireCheckInterval] = tailPeak;
+    }
+    
+    // A file that never gets above the tail threshold is played in full
+    info.inaudibleAfterFrame = (lastAbove >= 0) ? lastAbove + 1 : size;
+    
+    // Keep 1ms before the onset so the attack transient is not cut
+    int preroll = (int)(0.001 * sampleRate);
+    if (firstAbove < 0 || firstAbove < preroll)
+        info.onsetFrame = 0;
+    else
+        info.onsetFrame = firstAbove - preroll;
+    if (info.onsetFrame >= info.inaudibleAfterFrame)
+        info.onsetFrame = info.inaudibleAfterFrame - 1;
 }
 
 void Sampler::trigger() {
-    sampleSelector = std::rand() % sampleBuffers.size();
-    readPointer = 0;
-    amplitudeADSR.trigger();
+    if (!voices)
+        return;
+    sampleSelector = nextRandom() % sampleBuffers.size();
+    const SampleInfo& info = sampleInfos[sampleSelector];
+    
+    // Loops are always played in full so their length (and groove) is kept
+    int startFrame = 0;
+    int endFrame = sampleBuffers[sampleSelector].size();
+    if (autoTrim && !loopMode) {
+        startFrame = info.onsetFrame;
+        endFrame = info.inaudibleAfterFrame;
+    }
+    
+    // Only loops are played by the granular player
+    GrainPlayer* grainPlayer = nullptr;
+    if (granularMode && loopMode) {
+        grains.start(sampleBuffers[sampleSelector].data(), endFrame);
+        grainPlayer = &grains;
+    }
+    voices->trigger(voice, sampleBuffers[sampleSelector].data(), startFrame, endFrame, loopMode,
+                    info.tailPeaks.data(), info.peak, grainPlayer);
     //rt_printf("loaded sample variation #%d\n", sampleSelector);
 }
 
 void Sampler::release() {
-    amplitudeADSR.release();
+    if (voices)
+        voices->release(voice);
     //rt_printf("released\n");
 }
 
+void Sampler::setVoice(VoiceBank* voices, int voice) {
+    if (voice < 0 || voice >= VoiceBank::kMaxVoices) {
+        throw std::runtime_error("Voice " + std::to_string(voice) + " is outside the VoiceBank");
+    }
+    this->voices = voices;
+    this->voice = voice;
+    updateADSR();
+    voices->setRetireThreshold(voice, retireThreshold);
+}
+
 void Sampler::setAttackTime(float attackTime) {
     this->attackTime = attackTime;
     updateADSR();
@@ -74,10 +188,8 @@ void Sampler::setAdsrParameters(float attackTime, float decayTime, float sustain
 }
 
 void Sampler::updateADSR() {
-    amplitudeADSR.setAttackTime(attackTime);
-    amplitudeADSR.setDecayTime(decayTime);
-    amplitudeADSR.setSustainLevel(sustainLevel);
-    amplitudeADSR.setReleaseTime(releaseTime);
+    if (voices)
+        voices->setEnvelope(voice, attackTime, decayTime, sustainLevel, releaseTime);
 }
 
 void Sampler::setMidiNote(int midiNote) {
@@ -105,22 +217,49 @@ bool Sampler::getLoopMode() const {
     return loopMode;
 }
 
-float Sampler::process() {
-    if (readPointer == -1) {
-        return 0.f;
-    }
+void Sampler::setGranularMode(bool granular) {
+    this->granularMode = granular;
+}
 
-    float out = 0.5 * sampleBuffers[sampleSelector][readPointer] * amplitudeADSR.process();
-    readPointer++;
-    
-    if (readPointer >= static_cast<int>(sampleBuffers[sampleSelector].size())) {
-        if (loopMode) {
-            readPointer = 0;  // Reset to start of sample if in loop mode
-        } else {
-        	release();
-        	readPointer = -1; // Release if not in loop mode
-        }
-    }
+bool Sampler::getGranularMode() const {
+    return granularMode;
+}
+
+void Sampler::setTimeStretch(float speed) {
+    grains.setSpeed(speed);
+}
+
+float Sampler::getTimeStretch() const {
+    return grains.getSpeed();
+}
 
-    return out;
-}
\ No newline at end of file
+void Sampler::setAutoTrim(bool autoTrim) {
+    this->autoTrim = autoTrim;
+}
+
+bool Sampler::getAutoTrim() const {
+    return autoTrim;
+}
+
+void Sampler::setTrimThresholds(float onsetThresholdDb, float tailThresholdDb) {
+    this->onsetThresholdDb = onsetThresholdDb;
+    this->tailThresholdDb = tailThresholdDb;
+}
+
+void Sampler::setRetireThreshold(float retireThresholdDb) {
+    retireThreshold = powf(10.0, retireThresholdDb / 20.0);
+    if (voices)
+        voices->setRetireThreshold(voice, retireThreshold);
+}
+
+int Sampler::getNumSamples() const {
+    return sampleBuffers.size();
+}
+
+const Sampler::SampleInfo& Sampler::getSampleInfo(int index) const {
+    return sampleInfos[index];
+}
+
+bool Sampler::isActive() const {
+    return voices && voices->isActive(voice);
+}
@@ -3,18 +3,30 @@
 
 #include <vector>
 #include <string>
-#include "ADSR.h"
+#include "VoiceBank.h"
+#include "GrainPlayer.h"
 
 class Sampler {
 public:
     Sampler();
     void setFilenames(const std::vector<std::string>& filenames);
     void setup(float sampleRate);
+    
+    // Use sounds already in memory instead of loading the files (e.g. synthetic sounds)
+    void setSampleBuffers(const std::vector<std::vector<float>>& buffers, float sampleRate);
+    
+    // Seed the choice of sound variation, to make it repeatable. setup() seeds it from the clock
+    void setRandomSeed(unsigned int seed);
+    
     void trigger();
     void release();
-    float process();
     
-    ADSR amplitudeADSR;
+    // Set the voice of the bank that plays this sampler's sounds. Until then
+    // trigger() and release() do nothing
+    void setVoice(VoiceBank* voices, int voice);
+    
+    // Indicate whether the sampler is currently playing a sound
+    bool isActive() const;
     
     // Setter methods for ADSR parameters
     void setAttackTime(float attackTime);
@@ -36,13 +48,47 @@ public:
     // Setter and getter for loop mode
     void setLoopMode(bool loop);
     bool getLoopMode() const;
-
+    
+    // Setter and getter for granular mode, which lets loops be time-stretched
+    void setGranularMode(bool granular);
+    bool getGranularMode() const;
+    
+    // Setter and getter for the speed of a loop in granular mode:
+    // 1 is the recorded tempo, 0.5 half of it, without changing the pitch
+    void setTimeStretch(float speed);
+    float getTimeStretch() const;
+    
+    // Setter and getter for auto trim (skip leading silence and stop at the inaudible tail)
+    void setAutoTrim(bool autoTrim);
+    bool getAutoTrim() const;
+    
+    // Set the thresholds (in dBFS) used by the load-time analysis. Must be called before setup()
+    void setTrimThresholds(float onsetThresholdDb, float tailThresholdDb);
+    
+    // Set the level (in dBFS) below which a playing voice is retired early
+    void setRetireThreshold(float retireThresholdDb);
+    
+    // Results of the load-time analysis of each sound file
+    struct SampleInfo {
+        int onsetFrame;           // First frame to play (leading silence skipped)
+        int inaudibleAfterFrame;  // Frame after the last one above the tail threshold
+        float peak;               // Absolute peak level (linear)
+        float rms;                // RMS level of the whole file (linear)
+        std::vector<float> tailPeaks;  // Peak from each block of VoiceBank::kRetireCheckInterval frames to the end
+    };
+    
+    // Getters for the analysis results
+    int getNumSamples() const;
+    const SampleInfo& getSampleInfo(int index) const;
     
 private:
     std::vector<std::vector<float>> sampleBuffers;  // Buffer that holds the sound files
     std::vector<std::string> filenames; // Names of the sound files
-    int readPointer;
+    std::vector<SampleInfo> sampleInfos;  // Analysis results, one per sound file
+    VoiceBank* voices;  // Bank holding the playback state of the voice
+    int voice;  // Index of the voice in the bank
     int sampleSelector;
+    unsigned int randomState;  // State of the generator choosing the sound variation
     
     float attackTime;
     float decayTime;
@@ -52,8 +98,17 @@ private:
     int midiNote;  // Variable to hold the MIDI note associated with the sampler
     bool releaseOnNoteOff;  // Variable to determine if release is triggered on note off
     bool loopMode;  // Variable to enable/disable loop mode
+    bool granularMode;  // Variable to enable/disable granular playback of loops
+    GrainPlayer grains;  // Granular player used for loops in granular mode
+    bool autoTrim;  // Variable to enable/disable auto trim
+    float onsetThresholdDb;  // Level above which the sound is considered to start
+    float tailThresholdDb;   // Level below which the tail is considered inaudible
+    float retireThreshold;   // Linear output level below which the voice is retired
     
     void updateADSR();
+    void analyseSamples(float sampleRate);
+    void analyseSample(int index, float sampleRate);
+    unsigned int nextRandom();
 };
 
 #endif // SAMPLER_H
\ No newline at end of file
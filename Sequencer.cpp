@@ -0,0 +1,281 @@
+#include "Sequencer.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cmath>
+
+Sequencer::Sequencer() :
+    currentPattern(-1), nextPattern(-1), currentStep(0),
+    sampleRate(44100.0), tempo(100.0), samplesPerStep(0), samplesUntilNextStep(0), clockCount(0),
+    clockPeriod(0), clockIntervals(0), framesSinceClock(-1), nextStepClock(0), waitingForClock(false),
+    followMidiClock(false), playing(false),
+    noteOnCallback(nullptr), noteOffCallback(nullptr)
+{
+}
+
+void Sequencer::setup(float sampleRate) {
+    this->sampleRate = sampleRate;
+    updateSamplesPerStep();
+}
+
+// Pattern files are plain text. Empty lines and lines starting with '#'
+// are ignored; "steps_per_beat N" sets the step length, and every other
+// line is a track: MIDI note, velocity and one character per step, e.g.
+//   68 127 x...x...x.x.x...
+// Spaces and '|' between steps are ignored so bars can be laid out.
+int Sequencer::loadPattern(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Error loading pattern file '" + filename + "'");
+    }
+    
+    Pattern pattern;
+    pattern.stepsPerBeat = 4;
+    pattern.numSteps = 0;
+    
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream stream(line);
+        std::string first;
+        if (!(stream >> first) || first[0] == '#')
+            continue;
+        
+        if (first == "steps_per_beat") {
+            stream >> pattern.stepsPerBeat;
+            // Steps must fall on MIDI clocks to be able to follow them
+            if (pattern.stepsPerBeat <= 0 || kMidiClocksPerBeat % pattern.stepsPerBeat != 0) {
+                throw std::runtime_error("Invalid steps_per_beat in pattern file '" + filename + "'");
+            }
+            continue;
+        }
+        
+        Track track;
+        track.midiNote = std::stoi(first);
+        track.sounding = false;
+        if (!(stream >> track.velocity)) {
+            throw std::runtime_error("Missing velocity in pattern file '" + filename + "'");
+        }
+        char c;
+        while (stream >> c) {
+            if (c == 'x' || c == '-' || c == '.')
+                track.steps.push_back(c);
+            else if (c != '|')
+                throw std::runtime_error("Invalid step '" + std::string(1, c) + "' in pattern file '" + filename + "'");
+        }
+        if (pattern.numSteps == 0)
+            pattern.numSteps = track.steps.size();
+        if (track.steps.size() == 0 || static_cast<int>(track.steps.size()) != pattern.numSteps) {
+            throw std::runtime_error("Tracks of different lengths in pattern file '" + filename + "'");
+        }
+        pattern.tracks.push_back(track);
+    }
+    
+    if (pattern.tracks.size() == 0) {
+        throw std::runtime_error("No tracks in pattern file '" + filename + "'");
+    }
+    
+    patterns.push_back(pattern);
+    if (currentPattern < 0) {
+        currentPattern = nextPattern = 0;
+        updateSamplesPerStep();
+    }
+    return patterns.size() - 1;
+}
+
+int Sequencer::getNumPatterns() const {
+    return patterns.size();
+}
+
+void Sequencer::selectPattern(int index) {
+    if (index < 0 || index >= static_cast<int>(patterns.size()))
+        return;
+    nextPattern = index;
+    if (!playing) {
+        currentPattern = index;
+        updateSamplesPerStep();
+    }
+}
+
+int Sequencer::getCurrentPattern() const {
+    return currentPattern;
+}
+
+void Sequencer::setNoteCallbacks(void (*noteOnCallback)(int, int), void (*noteOffCallback)(int)) {
+    this->noteOnCallback = noteOnCallback;
+    this->noteOffCallback = noteOffCallback;
+}
+
+void Sequencer::setTempo(float bpm) {
+    if (bpm > 0) {
+        tempo = bpm;
+        updateSamplesPerStep();
+    }
+}
+
+float Sequencer::getTempo() const {
+    return tempo;
+}
+
+void Sequencer::setFollowMidiClock(bool follow) {
+    followMidiClock = follow;
+    updateSamplesPerStep();
+}
+
+bool Sequencer::getFollowMidiClock() const {
+    return followMidiClock;
+}
+
+void Sequencer::start() {
+    currentStep = 0;
+    clockCount = 0;
+    nextStepClock = 0;
+    samplesUntilNextStep = 0;
+    waitingForClock = true;
+    playing = (currentPattern >= 0);
+}
+
+void Sequencer::continuePlaying() {
+    waitingForClock = true;
+    playing = (currentPattern >= 0);
+}
+
+void Sequencer::stop() {
+    playing = false;
+    releaseAll();
+}
+
+bool Sequencer::isPlaying() const {
+    return playing;
+}
+
+// When following MIDI clock, the clocks set the step length and phase like a
+// delay-locked loop: each clock moves the steps and the clock period a
+// little towards what it measures, so the jitter of the MIDI transport and
+// of the block it arrives in is smoothed out instead of reaching the steps.
+// The first clock after a start message is the first beat
+void Sequencer::clockTick() {
+    if (!followMidiClock)
+        return;
+    
+    // The period starts as the average spacing over the first beat of clocks,
+    // and keeps following the spacing until the steps are running
+    double maxClockPeriod = sampleRate * 60.0 / (kMinClockTempo * kMidiClocksPerBeat);
+    double previousSamplesPerStep = samplesPerStep;
+    if (framesSinceClock >= 0 && framesSinceClock <= maxClockPeriod) {
+        if (clockIntervals < kMidiClocksPerBeat) {
+            clockIntervals++;
+            clockPeriod += (framesSinceClock - clockPeriod) / clockIntervals;
+        } else if (!playing || waitingForClock) {
+            clockPeriod += kClockPeriodSmoothing * (framesSinceClock - clockPeriod);
+        }
+        updateSamplesPerStep();
+    }
+    framesSinceClock = 0;
+    
+    if (!playing)
+        return;
+    waitingForClock = false;
+    
+    // The frames left until the next step are a number of clocks, so they
+    // scale with the period
+    samplesUntilNextStep *= samplesPerStep / previousSamplesPerStep;
+    
+    // Compare the position of the steps, in clocks, with the clock just received.
+    // Steps more than half a step away are moved onto the clock at once
+    int clocksPerStep = getClocksPerStep();
+    double framesPerClock = samplesPerStep / clocksPerStep;
+    double error = (nextStepClock - samplesUntilNextStep / framesPerClock - clockCount) * framesPerClock;
+    if (fabs(error) > samplesPerStep / 2) {
+        samplesUntilNextStep += error;
+    } else {
+        samplesUntilNextStep += kClockPhaseCorrection * error;
+        if (clockIntervals >= kMidiClocksPerBeat) {
+            clockPeriod += kClockPeriodCorrection * error;
+            updateSamplesPerStep();
+        }
+    }
+    if (samplesUntilNextStep < 0)
+        samplesUntilNextStep = 0;
+    clockCount++;
+}
+
+int Sequencer::process(int maxFrames) {
+    int frames = maxFrames;
+    if (playing && !(followMidiClock && waitingForClock)) {
+        // The step length is kept as a fraction of a frame so the tempo does not drift
+        if (samplesUntilNextStep <= 0) {
+            playStep();
+            samplesUntilNextStep += samplesPerStep;
+        }
+        // Steps shorter than a frame still advance by one frame at a time,
+        // so the caller's loop over the block always makes progress
+        frames = (int)ceil(samplesUntilNextStep);
+        if (frames < 1)
+            frames = 1;
+        if (frames > maxFrames)
+            frames = maxFrames;
+        samplesUntilNextStep -= frames;
+    }
+    
+    // The clock period is measured in the frames processed between clocks
+    if (framesSinceClock >= 0)
+        framesSinceClock += frames;
+    return frames;
+}
+
+void Sequencer::playStep() {
+    // Pattern changes wait for the end of the current cycle
+    if (currentStep == 0 && nextPattern != currentPattern) {
+        releaseAll();
+        currentPattern = nextPattern;
+        updateSamplesPerStep();
+    }
+    nextStepClock += getClocksPerStep();
+    
+    Pattern& pattern = patterns[currentPattern];
+    for (size_t i = 0; i < pattern.tracks.size(); i++) {
+        Track& track = pattern.tracks[i];
+        char step = track.steps[currentStep];
+        if (step == 'x') {
+            if (track.sounding && noteOffCallback)
+                noteOffCallback(track.midiNote);
+            if (noteOnCallback)
+                noteOnCallback(track.midiNote, track.velocity);
+            track.sounding = true;
+        } else if (step == '.' && track.sounding) {
+            if (noteOffCallback)
+                noteOffCallback(track.midiNote);
+            track.sounding = false;
+        }
+    }
+    
+    currentStep++;
+    if (currentStep >= pattern.numSteps)
+        currentStep = 0;
+}
+
+// End every note held by the current pattern
+void Sequencer::releaseAll() {
+    if (currentPattern < 0)
+        return;
+    
+    Pattern& pattern = patterns[currentPattern];
+    for (size_t i = 0; i < pattern.tracks.size(); i++) {
+        if (pattern.tracks[i].sounding && noteOffCallback)
+            noteOffCallback(pattern.tracks[i].midiNote);
+        pattern.tracks[i].sounding = false;
+    }
+}
+
+void Sequencer::updateSamplesPerStep() {
+    int stepsPerBeat = (currentPattern >= 0) ? patterns[currentPattern].stepsPerBeat : 4;
+    if (followMidiClock && clockIntervals > 0 && clockPeriod > 0)
+        samplesPerStep = clockPeriod * (kMidiClocksPerBeat / stepsPerBeat);
+    else
+        samplesPerStep = sampleRate * 60.0 / (tempo * stepsPerBeat);
+}
+
+int Sequencer::getClocksPerStep() const {
+    int stepsPerBeat = (currentPattern >= 0) ? patterns[currentPattern].stepsPerBeat : 4;
+    return kMidiClocksPerBeat / stepsPerBeat;
+}
@@ -0,0 +1,107 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <vector>
+#include <string>
+
+// Step sequencer that triggers notes with sample-accurate timing from
+// inside render(), either on its own tempo or following MIDI clock
+class Sequencer {
+public:
+    Sequencer();
+    void setup(float sampleRate);
+    
+    // Load a pattern from a text file and return its index
+    int loadPattern(const std::string& filename);
+    int getNumPatterns() const;
+    
+    // Select the pattern to play. The change happens at the start of the
+    // next cycle of the current pattern, or immediately when stopped
+    void selectPattern(int index);
+    int getCurrentPattern() const;
+    
+    // Set the functions called when a step starts or ends a note
+    void setNoteCallbacks(void (*noteOnCallback)(int, int), void (*noteOffCallback)(int));
+    
+    // Setter and getter for the internal tempo, in beats per minute
+    void setTempo(float bpm);
+    float getTempo() const;
+    
+    // Setter and getter for following MIDI clock instead of the internal tempo
+    void setFollowMidiClock(bool follow);
+    bool getFollowMidiClock() const;
+    
+    // Transport, driven by MIDI start/continue/stop or by the application
+    void start();
+    void continuePlaying();
+    void stop();
+    bool isPlaying() const;
+    
+    // Handle a MIDI clock message (24 per quarter note), received at the
+    // frame the sequencer has reached with process()
+    void clockTick();
+    
+    // Play a step if one is due on the current frame, then advance the
+    // internal clock up to the frame before the next step, by at most
+    // maxFrames. Returns the number of frames advanced
+    int process(int maxFrames);
+    
+    static const int kMidiClocksPerBeat = 24;
+    
+    // How fast the step phase and the clock period follow the incoming
+    // clocks while playing, as the fraction of the error corrected per clock,
+    // and how fast the period follows the spacing of clocks before that
+    static constexpr double kClockPhaseCorrection = 0.02;
+    static constexpr double kClockPeriodCorrection = 0.0002;
+    static constexpr double kClockPeriodSmoothing = 0.02;
+    
+    // Clocks further apart than at this tempo are treated as a pause in the clock
+    static constexpr double kMinClockTempo = 20.0;
+
+private:
+    struct Track {
+        int midiNote;
+        int velocity;
+        std::vector<char> steps;  // 'x' starts a note, '-' holds it, '.' is silence
+        bool sounding;            // Whether the track has a note held at the moment
+    };
+    
+    struct Pattern {
+        int stepsPerBeat;
+        int numSteps;
+        std::vector<Track> tracks;
+    };
+    
+    std::vector<Pattern> patterns;
+    int currentPattern;
+    int nextPattern;
+    int currentStep;
+    
+    float sampleRate;
+    float tempo;
+    double samplesPerStep;
+    double samplesUntilNextStep;
+    int clockCount;  // MIDI clocks received since start
+    
+    // When following MIDI clock the steps are still played by process(), with
+    // the step length taken from the spacing between clocks. The clocks
+    // arrive at block boundaries, so they only adjust the period and phase
+    double clockPeriod;        // Smoothed frames per clock
+    int clockIntervals;        // Clock intervals measured, up to a beat
+    double framesSinceClock;
+    int nextStepClock;         // Clock on which the next step falls
+    bool waitingForClock;      // Started but no clock received yet
+    
+    bool followMidiClock;
+    bool playing;
+    
+    void (*noteOnCallback)(int, int);
+    void (*noteOffCallback)(int);
+    
+    void playStep();
+    void releaseAll();
+    void updateSamplesPerStep();
+    int getClocksPerStep() const;
+};
+
+#endif // SEQUENCER_H
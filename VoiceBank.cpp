@@ -0,0 +1,175 @@
+#include "VoiceBank.h"
+#include "GrainPlayer.h"
+
+VoiceBank::VoiceBank() : sampleRate(44100.0f)
+{
+    for (int v = 0; v < kMaxVoices; v++) {
+        buffer[v] = nullptr;
+        position[v] = -1;
+        end[v] = 0;
+        envValue[v] = 0;
+        envIncrement[v] = 0;
+        envCounter[v] = 0;
+        gain[v] = 0.5;
+        envStage[v] = StageOff;
+        loop[v] = false;
+        tailPeaks[v] = nullptr;
+        grains[v] = nullptr;
+        peak[v] = 0;
+        retireThreshold[v] = 0;
+        setEnvelope(v, 0.001, 0.001, 1, 0.001);
+    }
+}
+
+void VoiceBank::setup(float sampleRate) {
+    this->sampleRate = sampleRate;
+}
+
+// Parameters are constrained to a sensible range, like in ADSR
+void VoiceBank::setEnvelope(int voice, float attackTime, float decayTime, float sustainLevel, float releaseTime) {
+    this->attackTime[voice] = (attackTime >= 0) ? attackTime : 0;
+    this->decayTime[voice] = (decayTime >= 0) ? decayTime : 0;
+    if (sustainLevel < 0)
+        this->sustainLevel[voice] = 0;
+    else if (sustainLevel > 1)
+        this->sustainLevel[voice] = 1;
+    else
+        this->sustainLevel[voice] = sustainLevel;
+    this->releaseTime[voice] = (releaseTime >= 0) ? releaseTime : 0;
+}
+
+void VoiceBank::setRetireThreshold(int voice, float retireThreshold) {
+    this->retireThreshold[voice] = retireThreshold;
+}
+
+void VoiceBank::trigger(int voice, const float* buffer, int start, int end, bool loop,
+                        const float* tailPeaks, float peak, GrainPlayer* grains) {
+    this->buffer[voice] = buffer;
+    this->position[voice] = start;
+    this->end[voice] = end;
+    this->loop[voice] = loop;
+    this->tailPeaks[voice] = tailPeaks;
+    this->peak[voice] = peak;
+    this->grains[voice] = grains;
+
+    // The envelope starts from wherever it was, as ADSR::trigger() does
+    envStage[voice] = StageAttack;
+    rampTo(voice, 1.0, attackTime[voice]);
+}
+
+void VoiceBank::release(int voice) {
+    envStage[voice] = StageRelease;
+    rampTo(voice, 0.0, releaseTime[voice]);
+}
+
+// Same arithmetic as Ramp::rampTo(), including the truncation of the counter
+void VoiceBank::rampTo(int voice, float value, float time) {
+    envIncrement[voice] = (value - envValue[voice]) / (sampleRate * time);
+    envCounter[voice] = (int)(sampleRate * time);
+}
+
+// Move to the next envelope stage when the current ramp has finished,
+// as ADSR::process() does before producing each frame
+void VoiceBank::updateEnvelopeStage(int voice) {
+    if (envCounter[voice] != 0)
+        return;
+
+    if (envStage[voice] == StageAttack) {
+        envStage[voice] = StageDecay;
+        rampTo(voice, sustainLevel[voice], decayTime[voice]);
+    } else if (envStage[voice] == StageDecay) {
+        envStage[voice] = StageSustain;
+    } else if (envStage[voice] == StageRelease) {
+        envStage[voice] = StageOff;
+    }
+}
+
+// Decide whether the rest of the sound can no longer be heard: either the
+// envelope has finished its release, or the envelope level times the
+// loudest frame still to come is below the retire threshold
+bool VoiceBank::canRetire(int voice) const {
+    if (envStage[voice] == StageOff)
+        return true;
+    if (envStage[voice] == StageAttack)
+        return false;
+
+    // A loop wraps around, so any frame of it can still come
+    float remainingPeak = loop[voice] ? peak[voice] : tailPeaks[voice][position[voice] / kRetireCheckInterval];
+    return gain[voice] * remainingPeak * envValue[voice] < retireThreshold[voice];
+}
+
+// Each voice is rendered in runs of frames in which nothing but the
+// envelope ramp changes: a run ends at the end of the buffer, at the next
+// retirement check or when the envelope stage may change. Within a run
+// the frames are contiguous in the buffer, so the mixing loop can be
+// vectorised by the compiler
+void VoiceBank::render(float* out, int frames) {
+    float envelope[kRetireCheckInterval];
+    float grainOutput[kRetireCheckInterval];
+
+    for (int n = 0; n < frames; n++)
+        out[n] = 0;
+
+    for (int v = 0; v < kMaxVoices; v++) {
+        int n = 0;
+        while (n < frames && position[v] >= 0) {
+            updateEnvelopeStage(v);
+
+            int run = frames - n;
+            if (run > end[v] - position[v])
+                run = end[v] - position[v];
+            int framesToCheck = kRetireCheckInterval - position[v] % kRetireCheckInterval;
+            if (run > framesToCheck)
+                run = framesToCheck;
+            // A stage that has just started with a zero length ramp still
+            // has to play one frame before it changes again
+            if (envStage[v] != StageSustain && envStage[v] != StageOff) {
+                int framesToStageEnd = (envCounter[v] > 0) ? envCounter[v] : 1;
+                if (run > framesToStageEnd)
+                    run = framesToStageEnd;
+            }
+
+            // A granular voice only uses its position to time the retirement
+            // checks and plays the grains rendered for this run instead
+            const float* in = buffer[v] + position[v];
+            if (grains[v]) {
+                grains[v]->render(grainOutput, run);
+                in = grainOutput;
+            }
+            float* mix = out + n;
+            float voiceGain = gain[v];
+
+            if (envCounter[v] > 0) {
+                // Ramping: the level is updated before each frame is played
+                float level = envValue[v];
+                float increment = envIncrement[v];
+                for (int k = 0; k < run; k++) {
+                    level += increment;
+                    envelope[k] = level;
+                }
+                envValue[v] = level;
+                envCounter[v] -= run;
+                for (int k = 0; k < run; k++)
+                    mix[k] += voiceGain * in[k] * envelope[k];
+            } else {
+                float level = envValue[v];
+                for (int k = 0; k < run; k++)
+                    mix[k] += voiceGain * in[k] * level;
+            }
+
+            position[v] += run;
+            n += run;
+
+            if (position[v] >= end[v]) {
+                if (loop[v]) {
+                    position[v] = 0;  // Reset to start of sample if in loop mode
+                } else {
+                    release(v);
+                    position[v] = -1;
+                }
+            } else if (position[v] % kRetireCheckInterval == 0 && canRetire(v)) {
+                position[v] = -1;
+            }
+        }
+    }
+}
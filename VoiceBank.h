@@ -0,0 +1,85 @@
+#ifndef VOICEBANK_H
+#define VOICEBANK_H
+
+class GrainPlayer;
+
+// State of every playing voice, kept as one array per field (struct of
+// arrays). Each voice is rendered in runs of frames rather than one frame
+// at a time, which is what makes it fast: tests/bench_voices.cpp shows the
+// same runs over one struct per voice cost about the same, since no step
+// reads across voices. The envelope follows the same stages and arithmetic
+// as ADSR and Ramp, so the output is the same as processing each voice one
+// frame at a time. ADSR and Ramp are kept as the reference:
+// tests/test_envelope.cpp checks the two match bit for bit
+class VoiceBank {
+public:
+    static const int kMaxVoices = 16;
+
+    // Number of frames between checks for early voice retirement
+    static const int kRetireCheckInterval = 64;
+
+    VoiceBank();
+
+    // Set the sample rate, used for the envelope times
+    void setup(float sampleRate);
+
+    // Set the envelope parameters of a voice
+    void setEnvelope(int voice, float attackTime, float decayTime, float sustainLevel, float releaseTime);
+
+    // Set the linear output level below which a voice is retired early
+    void setRetireThreshold(int voice, float retireThreshold);
+
+    // Start playing frames start to end - 1 of a buffer. A voice with
+    // loop set wraps back to frame 0. tailPeaks holds the peak from each
+    // block of kRetireCheckInterval frames to the end, peak the whole buffer's.
+    // With grains set, the voice plays the output of the grain player instead
+    void trigger(int voice, const float* buffer, int start, int end, bool loop,
+                 const float* tailPeaks, float peak, GrainPlayer* grains = nullptr);
+
+    // Start the release stage of the envelope
+    void release(int voice);
+
+    // Indicate whether a voice is playing
+    bool isActive(int voice) const { return position[voice] >= 0; }
+
+    // Write the mix of all voices for a number of frames into out
+    void render(float* out, int frames);
+
+private:
+    enum EnvelopeStage {
+        StageOff = 0,
+        StageAttack,
+        StageDecay,
+        StageSustain,
+        StageRelease
+    };
+
+    // Hot state, read and written by the render loop
+    const float* buffer[kMaxVoices];
+    int position[kMaxVoices];      // Next frame to play, -1 when the voice is off
+    int end[kMaxVoices];
+    float envValue[kMaxVoices];
+    float envIncrement[kMaxVoices];
+    int envCounter[kMaxVoices];
+    float gain[kMaxVoices];
+
+    // Cold state, only used when a voice changes stage, wraps or is checked for retirement
+    int envStage[kMaxVoices];
+    bool loop[kMaxVoices];
+    const float* tailPeaks[kMaxVoices];
+    GrainPlayer* grains[kMaxVoices];
+    float peak[kMaxVoices];
+    float retireThreshold[kMaxVoices];
+    float attackTime[kMaxVoices];
+    float decayTime[kMaxVoices];
+    float sustainLevel[kMaxVoices];
+    float releaseTime[kMaxVoices];
+
+    float sampleRate;
+
+    void rampTo(int voice, float value, float time);
+    void updateEnvelopeStage(int voice);
+    bool canRetire(int voice) const;
+};
+
+#endif // VOICEBANK_H
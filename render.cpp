@@ -20,8 +20,14 @@ sample-player: partially finished example that plays a
 #include <cmath>
 #include <vector>
 #include <ctime>
+#include <atomic>
 
 #include "Sampler.h"
+#include "VoiceBank.h"
+#include "Sequencer.h"
+#include "MidiPorts.h"
+#include "Kit.h"
+#include "MidiRouter.h"
 
 const bool debugMode = false;
 
@@ -30,7 +36,11 @@ const int kPercussionSamplers = 8;
 const int kBassSamplers = 8;
 const int kMaxSamplers = kBassSamplers + kPercussionSamplers;
 
+static_assert(kMaxSamplers <= VoiceBank::kMaxVoices, "Each sampler needs its own voice in the VoiceBank");
+
 Sampler samplers[kMaxSamplers];  // Array of Sampler objects
+VoiceBank gVoices;  // Playback state of the samplers, one voice each
+std::vector<float> gMixBuffer;  // Mix of all voices for one block
 
 std::vector<std::string> bassFilenames[kBassSamplers] = {
     {"samples/b1.wav"},
@@ -54,10 +64,75 @@ std::vector<std::string> percussionFilenames[kPercussionSamplers] = {
     {"samples/p8.3.1.wav"}
 };
 
-// Device for handling MIDI messages
-Midi gMidi;
+// Kits that a MIDI channel can play (or kKitNone)
+enum { kKitAll = 0, kKitBass, kKitPercussion };
+
+const Kit gKits[] = {
+    {0, kMaxSamplers},
+    {0, kBassSamplers},
+    {kBassSamplers, kPercussionSamplers}
+};
+
+// Kit played by each MIDI channel of a port (kKitNone ignores the channel),
+// and whether the port is sent the feedback of which samplers are playing.
+// Feedback must stay off for ports that echo their output back to their
+// input (loopback, MIDI thru), or it would retrigger the samplers
+struct MidiPortMapping {
+    const char* name;
+    int channelKits[16];
+    bool sendFeedback;
+};
+
+// Ports not listed here play every kit on every channel and get feedback,
+// except the virtual port which gets none
+const MidiPortMapping gMidiPortMappings[] = {
+    {"hw:1,0,0", {kKitAll, kKitAll, kKitAll, kKitAll, kKitAll, kKitAll, kKitAll, kKitAll,
+                  kKitAll, kKitAll, kKitAll, kKitAll, kKitAll, kKitAll, kKitAll, kKitAll}, true}
+};
+
+// Open an ALSA virtual port too, which other programs can connect to
+// (e.g. with aconnect) to play the sampler without any MIDI hardware
+const bool kUseVirtualMidiPort = false;
 
-const char* gMidiPort0 = "hw:1,0,0";
+// Devices for handling MIDI messages, one per port. Their bytes are
+// parsed and routed by gMidiRouter, where each port has the same index
+const int kMaxMidiPorts = MidiRouter::kMaxPorts;
+
+struct MidiPort {
+    Midi midi;
+    std::string name;
+    bool canWrite;
+    bool sendFeedback;
+};
+
+MidiPort gMidiPorts[kMaxMidiPorts];
+int gNumMidiPorts = 0;
+MidiRouter gMidiRouter;
+
+// Messages reporting which samplers are playing (e.g. to light up pad LEDs)
+// are queued by render() and sent by an auxiliary task, so the audio
+// thread never waits on the MIDI output
+const int kMidiOutQueueSize = 256;	// Must be a power of 2
+const int kMidiFeedbackChannel = 0;
+midi_byte_t gMidiOutQueue[kMidiOutQueueSize][3];
+std::atomic<unsigned int> gMidiOutWriteIndex(0);
+std::atomic<unsigned int> gMidiOutReadIndex(0);
+AuxiliaryTask gMidiOutTask;
+bool gSamplerWasActive[kMaxSamplers];
+
+// Internal step sequencer for the backing patterns
+Sequencer gSequencer;
+const bool kSequencerFollowsMidiClock = true;	// Otherwise play at kSequencerTempo
+const float kSequencerTempo = 100.0;
+const bool kSequencerAutoStart = false;		// Start without waiting for a MIDI start message
+
+// Control change setting the speed of the granular loops,
+// from half (value 0) to twice (value 127) their recorded tempo
+const int kLoopSpeedController = 1;
+
+std::vector<std::string> gPatternFilenames = {
+    "patterns/baque.txt"
+};
 
 // Handling for multiple MIDI notes
 const int kMaxActiveNotes = 16;
@@ -76,11 +151,51 @@ int gSampleSelector = 0;
 // Gui gGui;
 // GuiController gGuiController;
 
-// MIDI callback function
-void midiEvent(MidiChannelMessage message, void *arg);
+void noteOn(int noteNumber, int velocity);
+void noteOff(int noteNumber);
+void sendMidiOut(void* arg);
+
+// Open a MIDI port for reading (and writing if possible). Returns false if it cannot be read
+bool openMidiPort(const std::string& name, bool sendFeedback)
+{
+	if(gNumMidiPorts >= kMaxMidiPorts)
+		return false;
+	
+	MidiPort& port = gMidiPorts[gNumMidiPorts];
+	if(port.midi.readFrom(name.c_str()) < 0) {
+		rt_printf("Unable to read from MIDI port %s\n", name.c_str());
+		return false;
+	}
+	port.midi.enableParser(false);
+	port.canWrite = (port.midi.writeTo(name.c_str()) >= 0);
+	port.name = name;
+	
+	port.sendFeedback = sendFeedback;
+	int channelKits[16];
+	for(int channel = 0; channel < 16; channel++)
+		channelKits[channel] = kKitAll;
+	for(unsigned int i = 0; i < sizeof(gMidiPortMappings) / sizeof(gMidiPortMappings[0]); i++) {
+		if(name == gMidiPortMappings[i].name) {
+			for(int channel = 0; channel < 16; channel++)
+				channelKits[channel] = gMidiPortMappings[i].channelKits[channel];
+			port.sendFeedback = gMidiPortMappings[i].sendFeedback;
+		}
+	}
+	gMidiRouter.addPort(channelKits);
+	
+	rt_printf("Opened MIDI port %s\n", name.c_str());
+	gNumMidiPorts++;
+	return true;
+}
 
 bool setup(BelaContext *context, void *userData)
 {
+	gVoices.setup(context->audioSampleRate);
+	gMixBuffer.resize(context->audioFrames);
+	for (int i = 0; i < kMaxSamplers; ++i) {
+        samplers[i].setVoice(&gVoices, i);
+    }
+    
 	for (int i = 0; i < kBassSamplers; ++i) {
         samplers[i].setFilenames(bassFilenames[i]);
         samplers[i].setup(context->audioSampleRate);
@@ -102,17 +217,48 @@ bool setup(BelaContext *context, void *userData)
     samplers[kBassSamplers + 7 - 1].setReleaseOnNoteOff(true);
     samplers[kBassSamplers + 7 - 1].setAdsrParameters(0.01, 0.0, 1.0, 0.1);
     samplers[kBassSamplers + 7 - 1].setLoopMode(true);
+    // Granular playback lets the ganzás follow other tempos (see kLoopSpeedController)
+    samplers[kBassSamplers + 3 - 1].setGranularMode(true);
+    samplers[kBassSamplers + 7 - 1].setGranularMode(true);
     
 	
-	// Initialise the MIDI device
-	if(gMidi.readFrom(gMidiPort0) < 0) {
-		if (debugMode) rt_printf("Unable to read from MIDI port %s\n", gMidiPort0);
-		return false;
+    // Load the sequencer patterns. A missing pattern only disables that pattern
+    gSequencer.setup(context->audioSampleRate);
+    gSequencer.setTempo(kSequencerTempo);
+    gSequencer.setFollowMidiClock(kSequencerFollowsMidiClock);
+    gSequencer.setNoteCallbacks(noteOn, noteOff);
+    for (unsigned int i = 0; i < gPatternFilenames.size(); i++) {
+        try {
+            gSequencer.loadPattern(gPatternFilenames[i]);
+        } catch (std::exception& e) {
+            rt_printf("%s\n", e.what());
+        }
+    }
+    if (kSequencerAutoStart && !kSequencerFollowsMidiClock) {
+        gSequencer.start();
+    }
+	
+	gMidiRouter.setup(samplers, gKits, &gSequencer);
+	gMidiRouter.setLoopSpeedController(kLoopSpeedController);
+	
+	// Initialise a MIDI device for every port found. The bytes are read and
+	// parsed in render() so that notes and clock are handled on the audio thread.
+	// Without any port the sampler can still be played by the sequencer
+	std::vector<std::string> midiPortNames = findMidiInputPorts();
+	for(unsigned int i = 0; i < midiPortNames.size(); i++) {
+		openMidiPort(midiPortNames[i], true);
+	}
+	if(kUseVirtualMidiPort) {
+		openMidiPort("virtual", false);
+	}
+	if(gNumMidiPorts == 0) {
+		rt_printf("No MIDI port available\n");
 	}
 	
-	gMidi.writeTo(gMidiPort0);
-	gMidi.enableParser(true);
-	gMidi.setParserCallback(midiEvent, (void *)gMidiPort0);
+	if((gMidiOutTask = Bela_createAuxiliaryTask(sendMidiOut, 50, "midi-out")) == 0)
+		return false;
+	for(int i = 0; i < kMaxSamplers; i++)
+		gSamplerWasActive[i] = false;
 	
 	// // Set up the GUI
 	// gGui.setup(context->projectName);
@@ -127,14 +273,23 @@ bool setup(BelaContext *context, void *userData)
 	return true;
 }
 
+// MIDI note on received for the samplers of a kit
+void kitNoteOn(int kit, int noteNumber, int velocity)
+{
+    kitNoteOn(samplers, gKits[kit], noteNumber);
+}
+
+// MIDI note off received for the samplers of a kit
+void kitNoteOff(int kit, int noteNumber)
+{
+    if (debugMode) rt_printf("Note Off\n");
+    kitNoteOff(samplers, gKits[kit], noteNumber);
+}
+
 // MIDI note on received
 void noteOn(int noteNumber, int velocity) 
 {
-    for (int i = 0; i < kMaxSamplers; ++i) {
-        if (noteNumber == samplers[i].getMidiNote()) {
-            samplers[i].trigger();
-        }
-    }
+    kitNoteOn(kKitAll, noteNumber, velocity);
 
 	// Check if we have any note slots left
 	// if(gActiveNoteCount < kMaxActiveNotes) {
@@ -157,12 +312,7 @@ void noteOn(int noteNumber, int velocity)
 // MIDI note off received
 void noteOff(int noteNumber)
 {
-    for (int i = 0; i < kMaxSamplers; ++i) {
-        if (noteNumber == samplers[i].getMidiNote() && samplers[i].getReleaseOnNoteOff()) {
-        	if (debugMode) rt_printf("Note Off\n");
-            samplers[i].release();
-        }
-    }
+    kitNoteOff(kKitAll, noteNumber);
 	// bool activeNoteChanged = false;
 	
 	// // Go through all the active notes and remove any with this number
@@ -212,65 +362,69 @@ void render(BelaContext *context, void *userData)
     //   gGuiController.getSliderValue(3)
     // );
 	
+	// Handle the MIDI bytes that arrived on every port since the last block.
+	// The Midi class keeps no arrival time, so the ports are handled one after
+	// another: within a block, events from different ports are not in the
+	// order they arrived in. A note off on one port and a note on for the same
+	// sampler on another can then swap places; events a block apart cannot
+	for(int port = 0; port < gNumMidiPorts; port++) {
+		int byte;
+		while((byte = gMidiPorts[port].midi.getInput()) >= 0) {
+			gMidiRouter.parseByte(port, byte);
+		}
+	}
+	
+    // Render the voices in runs that end where a sequencer step falls,
+    // so steps are triggered on the exact frame they fall on
+    for (unsigned int n = 0; n < context->audioFrames; ) {
+        int frames = gSequencer.process(context->audioFrames - n);
+        gVoices.render(&gMixBuffer[n], frames);
+        n += frames;
+    }
+    
     for (unsigned int n = 0; n < context->audioFrames; n++) {
-        float out = 0;
-        
-        for (int i = 0; i < kMaxSamplers; ++i) {
-            out += samplers[i].process();
-        }
- 
         // Write the sample to every audio output channel
         for (unsigned int channel = 0; channel < context->audioOutChannels; channel++) {
-            audioWrite(context, n, channel, out);
+            audioWrite(context, n, channel, gMixBuffer[n]);
         }
     }
+    
+    // Report the samplers that started or stopped playing in this block
+    bool queued = false;
+    for (int i = 0; i < kMaxSamplers; ++i) {
+        bool active = samplers[i].isActive();
+        if (active == gSamplerWasActive[i])
+            continue;
+        
+        unsigned int writeIndex = gMidiOutWriteIndex.load(std::memory_order_relaxed);
+        if (writeIndex - gMidiOutReadIndex.load(std::memory_order_acquire) >= kMidiOutQueueSize)
+            break;	// Queue full: try again in the next block
+        
+        midi_byte_t* message = gMidiOutQueue[writeIndex & (kMidiOutQueueSize - 1)];
+        message[0] = 0x90 | kMidiFeedbackChannel;
+        message[1] = samplers[i].getMidiNote();
+        message[2] = active ? 127 : 0;
+        gMidiOutWriteIndex.store(writeIndex + 1, std::memory_order_release);
+        gSamplerWasActive[i] = active;
+        queued = true;
+    }
+    if (queued)
+        Bela_scheduleAuxiliaryTask(gMidiOutTask);
 }
 
-// This callback function is called every time a new MIDI message is available
-// This happens on a different thread than the audio processing
-
-void midiEvent(MidiChannelMessage message, void *arg) {
-	// Display the port, if available
-	if(arg != NULL) {
-		if (debugMode) rt_printf("Message from midi port %s ", (const char*) arg);
-	}
-	
-	// Display the message
-	if (debugMode) message.prettyPrint();
-		
-	// A MIDI "note on" message type might actually hold a real
-	// note onset (e.g. key press), or it might hold a note off (key release).
-	// The latter is signified by a velocity of 0.
-	if(message.getType() == kmmNoteOn) {
-		int noteNumber = message.getDataByte(0);
-		int velocity = message.getDataByte(1);
-		
-		// Velocity of 0 is really a note off
-		if(velocity == 0) {
-			noteOff(noteNumber);
-		}
-		else {
-			noteOn(noteNumber, velocity);
+// Auxiliary task sending the queued MIDI messages to every port that can be written and takes feedback
+void sendMidiOut(void* arg)
+{
+	unsigned int readIndex = gMidiOutReadIndex.load(std::memory_order_relaxed);
+	while(readIndex != gMidiOutWriteIndex.load(std::memory_order_acquire)) {
+		midi_byte_t* message = gMidiOutQueue[readIndex & (kMidiOutQueueSize - 1)];
+		for(int port = 0; port < gNumMidiPorts; port++) {
+			if(gMidiPorts[port].canWrite && gMidiPorts[port].sendFeedback)
+				gMidiPorts[port].midi.writeOutput(message, 3);
 		}
+		readIndex++;
+		gMidiOutReadIndex.store(readIndex, std::memory_order_release);
 	}
-	else if(message.getType() == kmmNoteOff) {
-		// We can also encounter the "note off" message type which is the same
-		// as "note on" with a velocity of 0.
-		int noteNumber = message.getDataByte(0);
-		
-		noteOff(noteNumber);
-	}
-	// else if (message.getType() == kmmPitchBend) {
-	// 	int pitchBend = message.getDataByte(0) + (message.getDataByte(1) << 7);
-		
-	// 	pitchWheel(pitchBend);
-	// }
-	// else if (message.getType() == kmmControlChange) {
-	// 	int ccNumber = message.getDataByte(0);
-	// 	int ccValue = message.getDataByte(1);
-		
-	// 	controlChange(ccNumber, ccValue);
-	// }
 }
 
 void cleanup(BelaContext *context, void *userData)
@@ -0,0 +1,93 @@
+#ifndef REFERENCEVOICE_H
+#define REFERENCEVOICE_H
+
+// One voice played the way Sampler::process() did before VoiceBank: one
+// frame at a time with an ADSR object. Used as the reference that the
+// VoiceBank output must match, and as the AoS side of the benchmark
+
+#include "ADSR.h"
+
+class ReferenceVoice {
+public:
+    ReferenceVoice() :
+        buffer(nullptr), readPointer(-1), endFrame(0), loop(false),
+        tailPeaks(nullptr), peak(0), retireThreshold(0)
+    {
+    }
+
+    void setup(float sampleRate, float attackTime, float decayTime, float sustainLevel, float releaseTime) {
+        envelope.setSampleRate(sampleRate);
+        envelope.setAttackTime(attackTime);
+        envelope.setDecayTime(decayTime);
+        envelope.setSustainLevel(sustainLevel);
+        envelope.setReleaseTime(releaseTime);
+    }
+
+    void setRetireThreshold(float retireThreshold) {
+        this->retireThreshold = retireThreshold;
+    }
+
+    void trigger(const float* buffer, int start, int end, bool loop, const float* tailPeaks, float peak) {
+        this->buffer = buffer;
+        this->readPointer = start;
+        this->endFrame = end;
+        this->loop = loop;
+        this->tailPeaks = tailPeaks;
+        this->peak = peak;
+        envelope.trigger();
+    }
+
+    void release() {
+        envelope.release();
+    }
+
+    bool isActive() const {
+        return readPointer != -1;
+    }
+
+    float process() {
+        if (readPointer == -1) {
+            return 0.f;
+        }
+
+        float out = 0.5 * buffer[readPointer] * envelope.process();
+        readPointer++;
+
+        if (readPointer >= endFrame) {
+            if (loop) {
+                readPointer = 0;
+            } else {
+                release();
+                readPointer = -1;
+            }
+        } else if (readPointer % kRetireCheckInterval == 0 && canRetire()) {
+            readPointer = -1;
+        }
+
+        return out;
+    }
+
+    static const int kRetireCheckInterval = 64;
+
+private:
+    ADSR envelope;
+    const float* buffer;
+    int readPointer;
+    int endFrame;
+    bool loop;
+    const float* tailPeaks;
+    float peak;
+    float retireThreshold;
+
+    bool canRetire() {
+        if (!envelope.isActive())
+            return true;
+        if (envelope.isAttacking())
+            return false;
+
+        float remainingPeak = loop ? peak : tailPeaks[readPointer / kRetireCheckInterval];
+        return 0.5 * remainingPeak * envelope.getCurrentLevel() < retireThreshold;
+    }
+};
+
+#endif // REFERENCEVOICE_H
@@ -0,0 +1,59 @@
+#ifndef TESTUTILS_H
+#define TESTUTILS_H
+
+// Minimal checking macros and synthetic sounds shared by the tests
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static int gFailures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+            gFailures++; \
+        } \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tolerance) \
+    do { \
+        double a_ = (a), b_ = (b); \
+        if (!(fabs(a_ - b_) <= (tolerance))) { \
+            printf("%s:%d: CHECK_NEAR failed: %s = %.9g, %s = %.9g\n", __FILE__, __LINE__, #a, a_, #b, b_); \
+            gFailures++; \
+        } \
+    } while (0)
+
+// Report the result of a test program
+inline int testResult(const char* name) {
+    if (gFailures == 0)
+        printf("%s: all checks passed\n", name);
+    else
+        printf("%s: %d check(s) failed\n", name, gFailures);
+    return gFailures == 0 ? 0 : 1;
+}
+
+// Exponentially decaying sine after some leading silence
+inline std::vector<float> makeTone(int length, int silence, float frequency, float decayFrames, float sampleRate) {
+    std::vector<float> buffer(length, 0.f);
+    for (int n = silence; n < length; n++) {
+        buffer[n] = 0.8f * sinf(2.0f * (float)M_PI * frequency * n / sampleRate) * expf(-(n - silence) / decayFrames);
+    }
+    return buffer;
+}
+
+// Repeatable noise with a short decay every period frames, like a shaker loop
+inline std::vector<float> makeShaker(int length, int period, unsigned int seed) {
+    std::vector<float> buffer(length);
+    unsigned int state = seed;
+    for (int n = 0; n < length; n++) {
+        state = state * 1664525u + 1013904223u;
+        float noise = (state >> 9) / 4194304.0f - 1.0f;
+        buffer[n] = 0.5f * noise * expf(-(n % period) / (period * 0.15f));
+    }
+    return buffer;
+}
+
+#endif // TESTUTILS_H
@@ -0,0 +1,261 @@
+// Benchmark of VoiceBank against two array-of-structs versions, all
+// playing the same random triggers and releases on 16 voices:
+//  - ReferenceVoice, the previous Sampler::process() path: one frame at a
+//    time per voice, with its own ADSR
+//  - BlockVoice: one struct per voice, rendered in runs exactly like
+//    VoiceBank::render()
+// The first comparison measures block processing, the second the struct of
+// arrays layout on its own. All three outputs must be identical
+
+#include "TestUtils.h"
+#include "ReferenceVoice.h"
+#include "VoiceBank.h"
+#include <chrono>
+
+const float kSampleRate = 44100;
+const int kBlockSize = 16;
+const int kNumVoices = VoiceBank::kMaxVoices;
+const int kBlocks = 30 * 44100 / kBlockSize;
+
+// The state of one VoiceBank voice kept together in a struct, with the
+// same envelope and run logic (granular playback left out)
+class BlockVoice {
+public:
+    static const int kRetireCheckInterval = VoiceBank::kRetireCheckInterval;
+
+    BlockVoice() :
+        buffer(nullptr), position(-1), end(0), envValue(0), envIncrement(0), envCounter(0),
+        gain(0.5), envStage(StageOff), loop(false), tailPeaks(nullptr), peak(0),
+        retireThreshold(0), attackTime(0), decayTime(0), sustainLevel(1), releaseTime(0),
+        sampleRate(44100)
+    {
+    }
+
+    void setup(float sampleRate, float attackTime, float decayTime, float sustainLevel, float releaseTime) {
+        this->sampleRate = sampleRate;
+        this->attackTime = attackTime;
+        this->decayTime = decayTime;
+        this->sustainLevel = sustainLevel;
+        this->releaseTime = releaseTime;
+    }
+
+    void setRetireThreshold(float retireThreshold) {
+        this->retireThreshold = retireThreshold;
+    }
+
+    void trigger(const float* buffer, int start, int end, bool loop, const float* tailPeaks, float peak) {
+        this->buffer = buffer;
+        this->position = start;
+        this->end = end;
+        this->loop = loop;
+        this->tailPeaks = tailPeaks;
+        this->peak = peak;
+        envStage = StageAttack;
+        rampTo(1.0, attackTime);
+    }
+
+    void release() {
+        envStage = StageRelease;
+        rampTo(0.0, releaseTime);
+    }
+
+    void render(float* out, int frames) {
+        float envelope[kRetireCheckInterval];
+        int n = 0;
+        while (n < frames && position >= 0) {
+            updateEnvelopeStage();
+
+            int run = frames - n;
+            if (run > end - position)
+                run = end - position;
+            int framesToCheck = kRetireCheckInterval - position % kRetireCheckInterval;
+            if (run > framesToCheck)
+                run = framesToCheck;
+            if (envStage != StageSustain && envStage != StageOff) {
+                int framesToStageEnd = (envCounter > 0) ? envCounter : 1;
+                if (run > framesToStageEnd)
+                    run = framesToStageEnd;
+            }
+
+            const float* in = buffer + position;
+            float* mix = out + n;
+            if (envCounter > 0) {
+                float level = envValue;
+                for (int k = 0; k < run; k++) {
+                    level += envIncrement;
+                    envelope[k] = level;
+                }
+                envValue = level;
+                envCounter -= run;
+                for (int k = 0; k < run; k++)
+                    mix[k] += gain * in[k] * envelope[k];
+            } else {
+                for (int k = 0; k < run; k++)
+                    mix[k] += gain * in[k] * envValue;
+            }
+
+            position += run;
+            n += run;
+
+            if (position >= end) {
+                if (loop) {
+                    position = 0;
+                } else {
+                    release();
+                    position = -1;
+                }
+            } else if (position % kRetireCheckInterval == 0 && canRetire()) {
+                position = -1;
+            }
+        }
+    }
+
+private:
+    enum EnvelopeStage { StageOff = 0, StageAttack, StageDecay, StageSustain, StageRelease };
+
+    const float* buffer;
+    int position;
+    int end;
+    float envValue;
+    float envIncrement;
+    int envCounter;
+    float gain;
+    int envStage;
+    bool loop;
+    const float* tailPeaks;
+    float peak;
+    float retireThreshold;
+    float attackTime;
+    float decayTime;
+    float sustainLevel;
+    float releaseTime;
+    float sampleRate;
+
+    void rampTo(float value, float time) {
+        envIncrement = (value - envValue) / (sampleRate * time);
+        envCounter = (int)(sampleRate * time);
+    }
+
+    void updateEnvelopeStage() {
+        if (envCounter != 0)
+            return;
+        if (envStage == StageAttack) {
+            envStage = StageDecay;
+            rampTo(sustainLevel, decayTime);
+        } else if (envStage == StageDecay) {
+            envStage = StageSustain;
+        } else if (envStage == StageRelease) {
+            envStage = StageOff;
+        }
+    }
+
+    bool canRetire() const {
+        if (envStage == StageOff)
+            return true;
+        if (envStage == StageAttack)
+            return false;
+        float remainingPeak = loop ? peak : tailPeaks[position / kRetireCheckInterval];
+        return gain * remainingPeak * envValue < retireThreshold;
+    }
+};
+
+struct Sound {
+    std::vector<float> buffer;
+    std::vector<float> tailPeaks;
+    float peak;
+};
+
+Sound makeSound(int index) {
+    Sound sound;
+    sound.buffer = makeTone(44100 * (1 + index % 3), 0, 60 + 37 * index, 4410 * (1 + index % 5), kSampleRate);
+    int numBlocks = (sound.buffer.size() + VoiceBank::kRetireCheckInterval - 1) / VoiceBank::kRetireCheckInterval;
+    sound.tailPeaks.assign(numBlocks, 0);
+    float tailPeak = 0;
+    for (int n = sound.buffer.size() - 1; n >= 0; n--) {
+        tailPeak = fmaxf(tailPeak, fabsf(sound.buffer[n]));
+        if (n % VoiceBank::kRetireCheckInterval == 0)
+            sound.tailPeaks[n / VoiceBank::kRetireCheckInterval] = tailPeak;
+    }
+    sound.peak = sound.tailPeaks[0];
+    return sound;
+}
+
+double elapsed(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main() {
+    std::vector<Sound> sounds;
+    for (int v = 0; v < kNumVoices; v++)
+        sounds.push_back(makeSound(v));
+
+    // Settings of the kit in render.cpp: bass, percussion and two loops
+    VoiceBank voices;
+    voices.setup(kSampleRate);
+    ReferenceVoice references[kNumVoices];
+    BlockVoice blockVoices[kNumVoices];
+    bool loop[kNumVoices];
+    for (int v = 0; v < kNumVoices; v++) {
+        float decay = 0.0, sustain = 1.0, release = 1.0;
+        loop[v] = (v == 10 || v == 14);
+        if (v >= 8 && !loop[v]) {
+            decay = 3.0;
+            sustain = 0.0;
+            release = 3.0;
+        } else if (loop[v]) {
+            release = 0.1;
+        }
+        voices.setEnvelope(v, 0.01, decay, sustain, release);
+        voices.setRetireThreshold(v, 0.0001);
+        references[v].setup(kSampleRate, 0.01, decay, sustain, release);
+        references[v].setRetireThreshold(0.0001);
+        blockVoices[v].setup(kSampleRate, 0.01, decay, sustain, release);
+        blockVoices[v].setRetireThreshold(0.0001);
+    }
+
+    std::vector<float> perFrame(kBlocks * kBlockSize), aos(kBlocks * kBlockSize), soa(kBlocks * kBlockSize);
+    double perFrameTime = 0, aosTime = 0, soaTime = 0;
+    unsigned int random = 12345;
+    for (int block = 0; block < kBlocks; block++) {
+        random = random * 1103515245u + 12345u;
+        int v = (random >> 8) % kNumVoices;
+        const Sound& sound = sounds[v];
+        if ((random >> 16) % 40 == 0) {
+            voices.trigger(v, sound.buffer.data(), 0, sound.buffer.size(), loop[v], sound.tailPeaks.data(), sound.peak);
+            references[v].trigger(sound.buffer.data(), 0, sound.buffer.size(), loop[v], sound.tailPeaks.data(), sound.peak);
+            blockVoices[v].trigger(sound.buffer.data(), 0, sound.buffer.size(), loop[v], sound.tailPeaks.data(), sound.peak);
+        } else if ((random >> 16) % 40 == 1) {
+            voices.release(v);
+            references[v].release();
+            blockVoices[v].release();
+        }
+
+        int first = block * kBlockSize;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        for (int n = 0; n < kBlockSize; n++) {
+            float mix = 0;
+            for (int i = 0; i < kNumVoices; i++)
+                mix += references[i].process();
+            perFrame[first + n] = mix;
+        }
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        for (int n = 0; n < kBlockSize; n++)
+            aos[first + n] = 0;
+        for (int i = 0; i < kNumVoices; i++)
+            blockVoices[i].render(&aos[first], kBlockSize);
+        std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+        voices.render(&soa[first], kBlockSize);
+        std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+
+        perFrameTime += elapsed(t0, t1);
+        aosTime += elapsed(t1, t2);
+        soaTime += elapsed(t2, t3);
+    }
+
+    printf("AoS, per frame (ADSR):  %.3f us per block of %d frames\n", perFrameTime / kBlocks * 1e6, kBlockSize);
+    printf("AoS, runs (BlockVoice): %.3f us per block of %d frames\n", aosTime / kBlocks * 1e6, kBlockSize);
+    printf("SoA, runs (VoiceBank):  %.3f us per block of %d frames\n", soaTime / kBlocks * 1e6, kBlockSize);
+    CHECK(perFrame == soa);
+    CHECK(aos == soa);
+    return testResult("bench_voices");
+}
@@ -0,0 +1,11 @@
+// Stand-in for the Bela AudioFile library so the sampler can be built on
+// a plain Linux machine. Tests load their sounds with setSampleBuffers()
+#pragma once
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#define rt_printf(...) ((void)0)
+namespace AudioFileUtilities {
+	inline std::vector<float> loadMono(const std::string&) { return std::vector<float>(); }
+}
@@ -0,0 +1,150 @@
+// Envelope behaviour: Ramp and ADSR on their own, and the VoiceBank
+// envelope against an ADSR-driven reference voice
+
+#include "TestUtils.h"
+#include "ReferenceVoice.h"
+#include "Ramp.h"
+#include "ADSR.h"
+#include "VoiceBank.h"
+
+// The counter is truncated to whole frames while the increment is not,
+// so a ramp whose length is not a whole number of frames stops short
+void testRampTruncation() {
+    Ramp ramp(1000);
+    ramp.rampTo(1.0, 0.0025);  // 2.5 frames: counter 2, increment 0.4
+    int frames = 0;
+    while (!ramp.finished()) {
+        ramp.process();
+        frames++;
+    }
+    CHECK(frames == 2);
+    CHECK_NEAR(ramp.currentLevel(), 0.8, 1e-6);
+
+    // A ramp of zero length never applies its (infinite) increment
+    ramp.setValue(0.25);
+    ramp.rampTo(1.0, 0.0);
+    CHECK(ramp.finished());
+    CHECK(ramp.process() == 0.25f);
+}
+
+void testAdsrTransitions() {
+    ADSR adsr;
+    adsr.setSampleRate(1000);
+    adsr.setAttackTime(0.005);
+    adsr.setDecayTime(0.005);
+    adsr.setSustainLevel(0.5);
+    adsr.setReleaseTime(0.005);
+    CHECK(!adsr.isActive());
+
+    adsr.trigger();
+    CHECK(adsr.isActive());
+    CHECK(adsr.isAttacking());
+    float level = 0;
+    for (int n = 0; n < 5; n++)
+        level = adsr.process();
+    CHECK_NEAR(level, 1.0, 1e-6);
+    CHECK(adsr.isAttacking());
+
+    // The next frame moves to Decay and already takes its first step
+    level = adsr.process();
+    CHECK(!adsr.isAttacking());
+    CHECK_NEAR(level, 0.9, 1e-6);
+    for (int n = 0; n < 4; n++)
+        level = adsr.process();
+    CHECK_NEAR(level, 0.5, 1e-6);
+
+    // Sustain holds until release
+    for (int n = 0; n < 100; n++)
+        level = adsr.process();
+    CHECK_NEAR(level, 0.5, 1e-6);
+    CHECK(adsr.isActive());
+
+    adsr.release();
+    for (int n = 0; n < 5; n++)
+        level = adsr.process();
+    CHECK_NEAR(level, 0.0, 1e-6);
+    CHECK(adsr.isActive());
+    adsr.process();
+    CHECK(!adsr.isActive());
+}
+
+// A zero decay time goes through Decay for one frame without producing NaN
+void testAdsrZeroDecay() {
+    ADSR adsr;
+    adsr.setSampleRate(1000);
+    adsr.setAttackTime(0.002);
+    adsr.setDecayTime(0.0);
+    adsr.setSustainLevel(0.3);
+    adsr.trigger();
+    for (int n = 0; n < 10; n++) {
+        float level = adsr.process();
+        CHECK(level == level);
+    }
+    CHECK_NEAR(adsr.getCurrentLevel(), 1.0, 1e-6);
+}
+
+// VoiceBank must produce exactly what per-frame ADSR processing produces,
+// through triggers, retriggers, releases, loop wraps and retirement
+void testVoiceBankMatchesAdsr() {
+    const float sampleRate = 48000;
+    const int length = 3000;
+    std::vector<float> buffer = makeTone(length, 0, 440, 800, sampleRate);
+    std::vector<float> tailPeaks((length + VoiceBank::kRetireCheckInterval - 1) / VoiceBank::kRetireCheckInterval);
+    float tailPeak = 0;
+    for (int n = length - 1; n >= 0; n--) {
+        tailPeak = fmaxf(tailPeak, fabsf(buffer[n]));
+        if (n % VoiceBank::kRetireCheckInterval == 0)
+            tailPeaks[n / VoiceBank::kRetireCheckInterval] = tailPeak;
+    }
+
+    struct Settings { float attack, decay, sustain, release; bool loop; float threshold; };
+    const Settings settings[] = {
+        {0.01, 0.0, 1.0, 0.02, false, 0.0},
+        {0.01, 0.05, 0.0, 0.05, false, 0.0001},
+        {0.001, 0.0, 1.0, 0.01, true, 0.0001},
+        {0.0, 0.0, 0.7, 0.0, true, 0.0}
+    };
+
+    for (const Settings& s : settings) {
+        VoiceBank voices;
+        voices.setup(sampleRate);
+        voices.setEnvelope(0, s.attack, s.decay, s.sustain, s.release);
+        voices.setRetireThreshold(0, s.threshold);
+        ReferenceVoice reference;
+        reference.setup(sampleRate, s.attack, s.decay, s.sustain, s.release);
+        reference.setRetireThreshold(s.threshold);
+
+        const int blockSize = 16;
+        float out[blockSize];
+        int mismatches = 0;
+        for (int block = 0; block < 48000 / blockSize; block++) {
+            int frame = block * blockSize;
+            if (frame % 12000 == 0 || frame == 3200) {
+                voices.trigger(0, buffer.data(), 0, length, s.loop, tailPeaks.data(), tailPeaks[0]);
+                reference.trigger(buffer.data(), 0, length, s.loop, tailPeaks.data(), tailPeaks[0]);
+            }
+            if (frame % 12000 == 6000) {
+                voices.release(0);
+                reference.release();
+            }
+            voices.render(out, blockSize);
+            for (int n = 0; n < blockSize; n++) {
+                if (out[n] != reference.process())
+                    mismatches++;
+            }
+            if (voices.isActive(0) != reference.isActive())
+                mismatches++;
+        }
+        CHECK(mismatches == 0);
+    }
+}
+
+int main() {
+    static_assert(ReferenceVoice::kRetireCheckInterval == VoiceBank::kRetireCheckInterval,
+                  "Reference voice must check for retirement as often as VoiceBank");
+    testRampTruncation();
+    testAdsrTransitions();
+    testAdsrZeroDecay();
+    testVoiceBankMatchesAdsr();
+    return testResult("test_envelope");
+}
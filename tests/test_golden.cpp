@@ -0,0 +1,234 @@
+// Golden-render regression test: fixed scripts of raw MIDI bytes are
+// parsed by MidiRouter and played through a small kit of synthetic sounds,
+// and the output is compared, within a tolerance, against the renders
+// checked in under golden/. Any change to the DSP (SIMD, block processing,
+// fixed point...) must keep them within bounds, or regenerate them on
+// purpose with: test_golden --update
+
+#include "TestUtils.h"
+#include "Sampler.h"
+#include "Kit.h"
+#include "MidiRouter.h"
+#include "Sequencer.h"
+#include <cstring>
+#include <string>
+
+const float kSampleRate = 8000;
+const int kBlockSize = 16;
+const float kTolerance = 1e-6;
+const int kNumSamplers = 4;
+
+VoiceBank gVoices;
+Sampler gSamplers[kNumSamplers];
+Sequencer gSequencer;
+
+MidiRouter gRouter;
+
+const Kit gKits[] = {
+    {0, kNumSamplers},
+    {0, 2}
+};
+
+// On port 0, MIDI channel 1 plays every sampler and channel 2 only the
+// one-shot drums. On port 1, channel 1 plays the drums
+const int kPortKits[2][16] = {
+    {0, 1, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone,
+     kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone},
+    {1, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone,
+     kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone, kKitNone}
+};
+
+// Raw MIDI bytes received on a port, at the frame they are handled
+struct ScriptEvent {
+    int frame;
+    int port;
+    std::vector<unsigned char> bytes;
+};
+
+const ScriptEvent kOneShotScript[] = {
+    {0, 0, {0x90, 36, 127}},
+    {800, 0, {38, 100}},                  // Running status
+    {1000, 0, {0x80, 36, 0}},             // Ignored: the kick does not release on note off
+    {2000, 0, {0x90, 38, 0xF8, 100}},     // Clock in the middle; retrigger while the first hit plays
+    {2003, 1, {0x90, 36, 127}},
+    {3000, 1, {0x9F, 38, 127}},           // Channel 16 of port 1 plays nothing
+    {3500, 0, {0xF0, 0x7D, 38, 100, 0xF7}},  // Sysex ends the running status
+    {3600, 0, {38, 100}},
+    {4000, 0, {0x90, 38, 0}},             // Velocity 0 is a note off
+    {-1, 0, {}}
+};
+
+const ScriptEvent kLoopScript[] = {
+    {0, 0, {0x90, 42, 127}},
+    {400, 0, {46, 127}},
+    {4800, 0, {0x80, 42, 0}},             // Released after several wraps of the loop
+    {5000, 0, {0x91, 46, 0}},             // Channel 2 cannot reach the granular loop
+    {6400, 0, {0x90, 46}},
+    {6400, 0, {0}},                       // A message split across two reads
+    {-1, 0, {}}
+};
+
+// Noise shared by the one-shot variations
+std::vector<float> makeSnare(unsigned int seed) {
+    std::vector<float> buffer = makeShaker(2400, 2400, seed);
+    for (int n = 0; n < 80; n++)
+        buffer[n] = 0;
+    return buffer;
+}
+
+void setupKit() {
+    gVoices = VoiceBank();
+    gVoices.setup(kSampleRate);
+    for (int i = 0; i < kNumSamplers; i++) {
+        gSamplers[i] = Sampler();
+        gSamplers[i].setVoice(&gVoices, i);
+    }
+    gRouter = MidiRouter();
+    gRouter.setup(gSamplers, gKits, &gSequencer);
+    gRouter.addPort(kPortKits[0]);
+    gRouter.addPort(kPortKits[1]);
+
+    gSamplers[0].setSampleBuffers({makeTone(4000, 40, 60, 1200, kSampleRate)}, kSampleRate);
+    gSamplers[0].setAdsrParameters(0.002, 0.3, 0.0, 0.3);
+    gSamplers[0].setReleaseOnNoteOff(false);
+    gSamplers[0].setMidiNote(36);
+
+    gSamplers[1].setSampleBuffers({makeSnare(1), makeSnare(2), makeSnare(3)}, kSampleRate);
+    gSamplers[1].setAdsrParameters(0.001, 0.0, 1.0, 0.05);
+    gSamplers[1].setRandomSeed(7);
+    gSamplers[1].setMidiNote(38);
+
+    std::vector<float> shaker = makeShaker(2000, 500, 11);
+    gSamplers[2].setSampleBuffers({shaker}, kSampleRate);
+    gSamplers[2].setAdsrParameters(0.01, 0.0, 1.0, 0.1);
+    gSamplers[2].setLoopMode(true);
+    gSamplers[2].setMidiNote(42);
+
+    gSamplers[3].setSampleBuffers({shaker}, kSampleRate);
+    gSamplers[3].setAdsrParameters(0.01, 0.0, 1.0, 0.1);
+    gSamplers[3].setLoopMode(true);
+    gSamplers[3].setGranularMode(true);
+    gSamplers[3].setTimeStretch(0.75);
+    gSamplers[3].setMidiNote(46);
+}
+
+void playEvent(const ScriptEvent& event) {
+    for (size_t i = 0; i < event.bytes.size(); i++)
+        gRouter.parseByte(event.port, event.bytes[i]);
+}
+
+// Render a script, splitting blocks at the events so they land on their exact frame
+std::vector<float> renderScript(const ScriptEvent* script, int frames) {
+    std::vector<float> out(frames);
+    int next = 0;
+    for (int n = 0; n < frames; ) {
+        while (script[next].frame >= 0 && script[next].frame <= n)
+            playEvent(script[next++]);
+        int run = kBlockSize - n % kBlockSize;
+        if (script[next].frame >= 0 && script[next].frame - n < run)
+            run = script[next].frame - n;
+        if (run > frames - n)
+            run = frames - n;
+        gVoices.render(&out[n], run);
+        n += run;
+    }
+    return out;
+}
+
+void sequencerNoteOn(int noteNumber, int) {
+    kitNoteOn(gSamplers, gKits[0], noteNumber);
+}
+
+void sequencerNoteOff(int noteNumber) {
+    kitNoteOff(gSamplers, gKits[0], noteNumber);
+}
+
+// Render the sequencer the way render() does: runs end where steps fall
+std::vector<float> renderSequencer(int frames) {
+    gSequencer = Sequencer();
+    gSequencer.setup(kSampleRate);
+    gSequencer.setTempo(132);
+    gSequencer.setNoteCallbacks(sequencerNoteOn, sequencerNoteOff);
+    gSequencer.loadPattern(std::string(TEST_DATA_DIR) + "/pattern.txt");
+    gSequencer.start();
+
+    std::vector<float> out(frames);
+    for (int block = 0; block < frames; block += kBlockSize) {
+        for (int n = block; n < block + kBlockSize; ) {
+            int run = gSequencer.process(block + kBlockSize - n);
+            gVoices.render(&out[n], run);
+            n += run;
+        }
+    }
+    return out;
+}
+
+bool readGolden(const std::string& path, std::vector<float>& data) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data.resize(size / sizeof(float));
+    bool ok = fread(data.data(), sizeof(float), data.size(), file) == data.size();
+    fclose(file);
+    return ok;
+}
+
+void writeGolden(const std::string& path, const std::vector<float>& data) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        printf("Unable to write %s\n", path.c_str());
+        gFailures++;
+        return;
+    }
+    fwrite(data.data(), sizeof(float), data.size(), file);
+    fclose(file);
+}
+
+void compareWithGolden(const char* name, const std::vector<float>& render, bool update) {
+    std::string path = std::string(TEST_GOLDEN_DIR) + "/" + name + ".f32";
+    if (update) {
+        writeGolden(path, render);
+        printf("%s: golden render updated\n", name);
+        return;
+    }
+
+    std::vector<float> golden;
+    if (!readGolden(path, golden)) {
+        printf("%s: unable to read %s\n", name, path.c_str());
+        gFailures++;
+        return;
+    }
+    CHECK(golden.size() == render.size());
+
+    double maxError = 0;
+    int worstFrame = 0;
+    bool silent = true;
+    for (size_t n = 0; n < golden.size() && n < render.size(); n++) {
+        double error = fabs(golden[n] - render[n]);
+        if (!(error <= maxError)) {
+            maxError = error;
+            worstFrame = n;
+        }
+        if (render[n] != 0)
+            silent = false;
+    }
+    printf("%s: max error %.3g at frame %d\n", name, maxError, worstFrame);
+    CHECK(maxError <= kTolerance);
+    CHECK(!silent);
+}
+
+int main(int argc, char* argv[]) {
+    bool update = (argc > 1 && strcmp(argv[1], "--update") == 0);
+
+    setupKit();
+    compareWithGolden("oneshots", renderScript(kOneShotScript, 8000), update);
+    setupKit();
+    compareWithGolden("loops", renderScript(kLoopScript, 8000), update);
+    setupKit();
+    compareWithGolden("sequencer", renderSequencer(16000), update);
+
+    return testResult("test_golden");
+}
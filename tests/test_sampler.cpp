@@ -0,0 +1,283 @@
+// Sampler behaviour: load-time analysis, loop wrap, granular start, early retirement,
+// note routing through kits, sound variation seeding and sequencer timing
+
+#include "TestUtils.h"
+#include "Sampler.h"
+#include "Kit.h"
+#include "Sequencer.h"
+#include <string>
+
+const float kSampleRate = 8000;
+
+// Render a number of frames in blocks and return them
+std::vector<float> renderFrames(VoiceBank& voices, int frames) {
+    std::vector<float> out(frames);
+    for (int n = 0; n < frames; n += 16)
+        voices.render(&out[n], (frames - n < 16) ? frames - n : 16);
+    return out;
+}
+
+void testAnalysis() {
+    std::vector<std::vector<float>> buffers(1, makeTone(4000, 500, 200, 200, kSampleRate));
+    Sampler sampler;
+    sampler.setSampleBuffers(buffers, kSampleRate);
+    const Sampler::SampleInfo& info = sampler.getSampleInfo(0);
+
+    // The onset keeps 1ms (8 frames) before the first audible frame
+    CHECK(info.onsetFrame > 480 && info.onsetFrame <= 500);
+    CHECK(info.inaudibleAfterFrame > 500 && info.inaudibleAfterFrame < 4000);
+    CHECK(fabsf(buffers[0][info.inaudibleAfterFrame]) < powf(10.0, -70.0 / 20.0));
+    CHECK_NEAR(info.peak, 0.8, 0.05);
+    CHECK(info.rms > 0 && info.rms < info.peak);
+    CHECK(info.tailPeaks[0] == info.peak);
+    CHECK(info.tailPeaks.back() <= info.tailPeaks[0]);
+
+    // Without a voice the sampler can still be triggered, but plays nothing
+    sampler.trigger();
+    sampler.release();
+    CHECK(!sampler.isActive());
+}
+
+// A loop plays again from its first frame, one-shots stop at their end
+void testLoopWrap() {
+    const int length = 100;
+    std::vector<std::vector<float>> buffers(1, std::vector<float>(length));
+    for (int n = 0; n < length; n++)
+        buffers[0][n] = 0.5f + 0.5f * n / length;
+
+    VoiceBank voices;
+    voices.setup(kSampleRate);
+    Sampler loop;
+    loop.setVoice(&voices, 0);
+    loop.setSampleBuffers(buffers, kSampleRate);
+    loop.setAdsrParameters(0.001, 0.0, 1.0, 0.01);
+    loop.setLoopMode(true);
+    loop.trigger();
+
+    std::vector<float> out = renderFrames(voices, 10 * length);
+    CHECK(loop.isActive());
+    for (int n = 2 * length; n < 9 * length; n++)
+        CHECK(out[n] == out[n + length]);
+    CHECK(out[3 * length] < out[3 * length - 1]);  // The wrap point
+
+    Sampler oneShot;
+    oneShot.setVoice(&voices, 1);
+    oneShot.setSampleBuffers(buffers, kSampleRate);
+    oneShot.setAdsrParameters(0.001, 0.0, 1.0, 0.01);
+    oneShot.setAutoTrim(false);
+    loop.release();
+    oneShot.trigger();
+    renderFrames(voices, length - 1);
+    CHECK(oneShot.isActive());
+    renderFrames(voices, 1);
+    CHECK(!oneShot.isActive());
+
+    // A released loop stops at the first retirement check after its release ends
+    renderFrames(voices, 2 * length);
+    CHECK(!loop.isActive());
+}
+
+// At speed 1 the primed grains add back up to the plain loop from its first frame
+void testGranularStart() {
+    std::vector<float> loop = makeShaker(2000, 500, 5);
+    GrainPlayer grains;
+    grains.setup(kSampleRate);
+    grains.start(loop.data(), loop.size());
+
+    const int frames = 3 * loop.size();
+    std::vector<float> out(frames);
+    for (int n = 0; n < frames; n += 16)
+        grains.render(&out[n], 16);
+    float maxError = 0;
+    for (int n = 0; n < frames; n++)
+        maxError = fmaxf(maxError, fabsf(out[n] - loop[n % loop.size()]));
+    CHECK(maxError < 1e-5);
+}
+
+// A percussion voice with zero sustain is retired once its decay is inaudible,
+// long before the end of its (still audible) buffer
+void testEarlyRetirement() {
+    std::vector<std::vector<float>> buffers(1, makeTone(8000, 0, 100, 100000, kSampleRate));
+    VoiceBank voices;
+    voices.setup(kSampleRate);
+    Sampler sampler;
+    sampler.setVoice(&voices, 0);
+    sampler.setSampleBuffers(buffers, kSampleRate);
+    sampler.setAdsrParameters(0.001, 0.1, 0.0, 0.1);
+    sampler.trigger();
+    renderFrames(voices, 900);
+    CHECK(!sampler.isActive());
+}
+
+// Notes only reach the samplers of the kit they are routed to
+void testKitRouting() {
+    std::vector<std::vector<float>> buffers(1, std::vector<float>(4000, 0.5f));
+    VoiceBank voices;
+    voices.setup(kSampleRate);
+    Sampler samplers[3];
+    for (int i = 0; i < 3; i++) {
+        samplers[i].setVoice(&voices, i);
+        samplers[i].setSampleBuffers(buffers, kSampleRate);
+        samplers[i].setAdsrParameters(0.001, 0.0, 1.0, 0.01);
+    }
+    samplers[0].setMidiNote(60);
+    samplers[1].setMidiNote(61);
+    samplers[2].setMidiNote(60);
+    samplers[1].setReleaseOnNoteOff(false);
+    const Kit first = {0, 2};
+    const Kit second = {2, 1};
+
+    kitNoteOn(samplers, first, 60);
+    CHECK(samplers[0].isActive());
+    CHECK(!samplers[1].isActive());
+    CHECK(!samplers[2].isActive());
+
+    kitNoteOn(samplers, second, 60);
+    kitNoteOn(samplers, first, 61);
+    CHECK(samplers[1].isActive() && samplers[2].isActive());
+
+    // Note off on the first kit releases sampler 0 only; sampler 1 ignores note off
+    kitNoteOff(samplers, first, 60);
+    kitNoteOff(samplers, first, 61);
+    renderFrames(voices, 200);
+    CHECK(!samplers[0].isActive());
+    CHECK(samplers[1].isActive());
+    CHECK(samplers[2].isActive());
+}
+
+// The same seed chooses the same sequence of sound variations
+void testSeededVariations() {
+    std::vector<std::vector<float>> buffers;
+    for (int i = 0; i < 4; i++)
+        buffers.push_back(std::vector<float>(400, 0.1f * (i + 1)));
+
+    std::vector<float> renders[2];
+    for (int run = 0; run < 2; run++) {
+        VoiceBank voices;
+        voices.setup(kSampleRate);
+        Sampler sampler;
+        sampler.setVoice(&voices, 0);
+        sampler.setSampleBuffers(buffers, kSampleRate);
+        sampler.setAdsrParameters(0.001, 0.0, 1.0, 0.0);
+        sampler.setAutoTrim(false);
+        sampler.setRandomSeed(1234);
+        for (int note = 0; note < 20; note++) {
+            sampler.trigger();
+            std::vector<float> out = renderFrames(voices, 16);
+            renders[run].push_back(out[12]);
+        }
+    }
+    CHECK(renders[0] == renders[1]);
+    int different = 0;
+    for (size_t i = 1; i < renders[0].size(); i++)
+        different += (renders[0][i] != renders[0][i - 1]);
+    CHECK(different > 0);
+}
+
+std::vector<int> gStepFrames;
+int gCurrentFrame;
+
+void recordNoteOn(int, int) {
+    gStepFrames.push_back(gCurrentFrame);
+}
+
+void ignoreNoteOff(int) {
+}
+
+// Steps fall on the frame given by the fractional step length, without drift
+void testSequencerTiming() {
+    Sequencer sequencer;
+    sequencer.setup(kSampleRate);
+    sequencer.setTempo(130);  // 923.08 frames per step
+    sequencer.setNoteCallbacks(recordNoteOn, ignoreNoteOff);
+    sequencer.loadPattern(std::string(TEST_DATA_DIR) + "/every_step.txt");
+    sequencer.start();
+
+    gStepFrames.clear();
+    for (gCurrentFrame = 0; gCurrentFrame < 10000; )
+        gCurrentFrame += sequencer.process(16);
+    double samplesPerStep = kSampleRate * 60.0 / (130 * 4);
+    CHECK(gStepFrames.size() == 11);
+    for (size_t k = 32; k < gStepFrames.size(); k++)
+        CHECK(gStepFrames[k] == (int)ceil(k * samplesPerStep));
+
+    // Steps shorter than a frame still let the block advance
+    sequencer.setTempo(1000000);
+    int frames = 0;
+    for (int call = 0; call < 100 && frames < 64; call++)
+        frames += sequencer.process(64 - frames);
+    CHECK(frames == 64);
+}
+
+// Following MIDI clock, the clocks are only seen at the start of the block
+// they arrive in, with some transport jitter on top. The steps must still
+// be evenly spaced at the clock period, and stay in phase with the clocks
+void testSequencerClockFollow() {
+    const float sampleRate = 44100;
+    const int blockSize = 16;
+    const double framesPerClock = sampleRate * 60.0 / (120 * Sequencer::kMidiClocksPerBeat);
+    const double framesPerStep = framesPerClock * Sequencer::kMidiClocksPerBeat / 4;
+
+    Sequencer sequencer;
+    sequencer.setup(sampleRate);
+    sequencer.setFollowMidiClock(true);
+    sequencer.setNoteCallbacks(recordNoteOn, ignoreNoteOff);
+    sequencer.loadPattern(std::string(TEST_DATA_DIR) + "/every_step.txt");
+
+    // Clock k is sent at k * framesPerClock and arrives up to 2ms later
+    std::vector<double> clockArrivals;
+    unsigned int random = 1;
+    for (int k = 0; k < 24 * 64; k++) {
+        random = random * 1664525 + 1013904223;
+        clockArrivals.push_back(k * framesPerClock + (random >> 16) % 88);
+    }
+
+    gStepFrames.clear();
+    size_t clock = 0;
+    int firstClockFrame = -1;
+    for (gCurrentFrame = 0; clock < clockArrivals.size(); ) {
+        if (gCurrentFrame % blockSize == 0) {
+            while (clock < clockArrivals.size() && clockArrivals[clock] <= gCurrentFrame) {
+                if (clock == 0) {
+                    sequencer.start();
+                    firstClockFrame = gCurrentFrame;
+                }
+                sequencer.clockTick();
+                clock++;
+            }
+        }
+        gCurrentFrame += sequencer.process(blockSize - gCurrentFrame % blockSize);
+    }
+
+    // The first step plays on the block where the first clock is seen
+    CHECK(gStepFrames.size() > 200);
+    CHECK(gStepFrames[0] == firstClockFrame);
+
+    // After 8 beats the steps are evenly spaced within a few frames and keep
+    // a steady phase, while the clocks as seen by render() move by up to 104
+    double maxInterval = 0, minInterval = 1e9, maxPhase = -1e9, minPhase = 1e9;
+    for (size_t k = 32; k < gStepFrames.size(); k++) {
+        double interval = gStepFrames[k] - gStepFrames[k - 1];
+        maxInterval = fmax(maxInterval, interval);
+        minInterval = fmin(minInterval, interval);
+        double phase = gStepFrames[k] - k * framesPerStep;
+        maxPhase = fmax(maxPhase, phase);
+        minPhase = fmin(minPhase, phase);
+    }
+    printf("clock follow: step interval %.0f to %.0f (exact %.2f), phase %.0f to %.0f\n",
+           minInterval, maxInterval, framesPerStep, minPhase, maxPhase);
+    CHECK(maxInterval - minInterval <= 8);
+    CHECK(minPhase >= 0 && maxPhase - minPhase <= 32);
+}
+
+int main() {
+    testAnalysis();
+    testLoopWrap();
+    testGranularStart();
+    testEarlyRetirement();
+    testKitRouting();
+    testSeededVariations();
+    testSequencerTiming();
+    testSequencerClockFollow();
+    return testResult("test_sampler");
+}